@@ -0,0 +1,24 @@
+#version 150
+
+// Blur's pyramid on the way down, drawn into a target half the size of source: the centre
+// and four diagonal fetches half a target pixel (times offset) away, each of them
+// averaging four texels of source.
+
+uniform sampler2DRect source;
+uniform float offset;
+
+in vec2 texCoordVarying;
+
+out vec4 fragColor;
+
+void main() {
+    // Half a pixel of the target, in texels of source.
+    vec2 halfPixel = vec2(1.0) * offset;
+    
+    fragColor = texture(source, texCoordVarying) * 4.0;
+    fragColor += texture(source, texCoordVarying - halfPixel);
+    fragColor += texture(source, texCoordVarying + halfPixel);
+    fragColor += texture(source, texCoordVarying + vec2(halfPixel.x, -halfPixel.y));
+    fragColor += texture(source, texCoordVarying - vec2(halfPixel.x, -halfPixel.y));
+    fragColor /= 8.0;
+}
\ No newline at end of file
@@ -0,0 +1,26 @@
+#version 150
+
+// Blur's pyramid on the way up, drawn into a target twice the size of source: a ring of
+// four fetches along the axes and four, weighted double, along the diagonals.
+
+uniform sampler2DRect source;
+uniform float offset;
+
+in vec2 texCoordVarying;
+
+out vec4 fragColor;
+
+void main() {
+    // Half a texel of source.
+    vec2 halfTexel = vec2(.5) * offset;
+    
+    fragColor = texture(source, texCoordVarying + vec2(-halfTexel.x * 2.0, 0.0));
+    fragColor += texture(source, texCoordVarying + vec2(halfTexel.x * 2.0, 0.0));
+    fragColor += texture(source, texCoordVarying + vec2(0.0, -halfTexel.y * 2.0));
+    fragColor += texture(source, texCoordVarying + vec2(0.0, halfTexel.y * 2.0));
+    fragColor += texture(source, texCoordVarying + vec2(-halfTexel.x, halfTexel.y)) * 2.0;
+    fragColor += texture(source, texCoordVarying + vec2(halfTexel.x, halfTexel.y)) * 2.0;
+    fragColor += texture(source, texCoordVarying + vec2(halfTexel.x, -halfTexel.y)) * 2.0;
+    fragColor += texture(source, texCoordVarying + vec2(-halfTexel.x, -halfTexel.y)) * 2.0;
+    fragColor /= 12.0;
+}
\ No newline at end of file
@@ -1,38 +1,27 @@
 #version 150
 
+// One pass of Blur's Gaussian blur along direction. The weights and offsets come from
+// Blur::updateWeights(), with neighbouring taps merged into one fetch between them, which
+// needs the source to be linearly filtered.
+
+const int MaxTaps = 8;
+
 uniform vec4 globalColor;
 uniform sampler2DRect source;
 uniform vec2 direction;
-uniform float distribution = 9.f;
-uniform float kernelSize;
-
-uniform float M_PI = 3.14159265358979323846264338327950288;
+uniform float weights[MaxTaps];
+uniform float offsets[MaxTaps];
+uniform int numTaps;
 
 in vec2 texCoordVarying;
 
 out vec4 fragColor;
 
-void weight(in float x, in float d, out float w){
-    w = 1.f / ( sqrt(2*M_PI*d*d) ) * ( exp(-(x*x)/(2*d*d)) );
-}
-
 void main() {
-    float w = 1.f;
-    weight(0, distribution, w);
-    float weightedSum = w;
-    
-    fragColor = texture(source, texCoordVarying) * w;
-    
-    // Calculate sum of weights.
-    for (float i=1; i<kernelSize; i++) {
-        weight(i, distribution, w);
-        weightedSum += w*2;
-    }
+    fragColor = texture(source, texCoordVarying) * weights[0];
     
-    for (float i=1; i<kernelSize; i++) {
-        weight(i, distribution, w);
-        fragColor += texture(source, texCoordVarying + direction*i) * w / weightedSum;
-        
-        fragColor += texture(source, texCoordVarying - direction*i) * w / weightedSum;
+    for (int i=1; i<numTaps; i++) {
+        fragColor += texture(source, texCoordVarying + direction*offsets[i]) * weights[i];
+        fragColor += texture(source, texCoordVarying - direction*offsets[i]) * weights[i];
     }
 }
\ No newline at end of file
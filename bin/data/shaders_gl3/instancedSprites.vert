@@ -0,0 +1,81 @@
+#version 150
+
+// Draws every sprite of one texture in one call, see InstancedSpriteRenderer.h. Lit like
+// topLighting.vert, and used with topLighting.frag.
+
+uniform mat4 modelViewProjectionMatrix;
+
+uniform float toplightStartY;
+uniform float toplightIntensity;
+uniform float topLightEndY;
+uniform float ambientLight;
+
+// A unit plane with texture coordinates from 0 to 1, at one of InstancedSpriteRenderer's
+// levels of detail. crumpleLatticePoint.xy is the vertex's point on the crumple lattice,
+// .zw the offset to the two points it lies halfway between on the next coarser level.
+in vec4 position;
+in vec2 texcoord;
+in vec4 crumpleLatticePoint;
+
+// One SpriteInstance per sprite.
+in vec4 instancePositionAndSeed;
+in vec4 instanceOrientation;
+in vec4 instanceTexCoordRect;
+in vec4 instanceSizeHomenessAndMorph;
+
+out float brightness;
+out vec2 texCoordVarying;
+
+// The same hash as SpriteInstance::getCrumpleDisplacement().
+uint hash(uint x) {
+    x ^= x >> 16u;
+    x *= 0x7feb352du;
+    x ^= x >> 15u;
+    x *= 0x846ca68bu;
+    x ^= x >> 16u;
+    return x;
+}
+
+// As SpriteInstance::CrumpleLatticeSize.
+const int CrumpleLatticeSize = 48;
+
+float getCrumpleRandom(uint seed, int latticeIndex, int axis) {
+    return float(hash(seed * 0x9e3779b9u + uint(latticeIndex * 3 + axis)) >> 8u) / 16777216.0;
+}
+
+vec3 getCrumpleDisplacement(uint seed, vec2 latticePoint) {
+    int latticeIndex = int(latticePoint.y) * (CrumpleLatticeSize + 1) + int(latticePoint.x);
+    return vec3(getCrumpleRandom(seed, latticeIndex, 0),
+                getCrumpleRandom(seed, latticeIndex, 1),
+                getCrumpleRandom(seed, latticeIndex, 2));
+}
+
+vec3 rotate(vec4 quaternion, vec3 v) {
+    return v + 2.0 * cross(quaternion.xyz, cross(quaternion.xyz, v) + quaternion.w * v);
+}
+
+void main() {
+    vec2 size = instanceSizeHomenessAndMorph.xy;
+    float homeness = instanceSizeHomenessAndMorph.z;
+    float lodMorph = instanceSizeHomenessAndMorph.w;
+    uint seed = uint(instancePositionAndSeed.w);
+
+    // Vertices new at this level start on the coarser level's surface and move out to
+    // their own crumple as lodMorph goes to 1.
+    vec2 latticePoint = crumpleLatticePoint.xy;
+    vec2 parentOffset = crumpleLatticePoint.zw;
+    vec3 ownDisplacement = getCrumpleDisplacement(seed, latticePoint);
+    vec3 parentDisplacement = (getCrumpleDisplacement(seed, latticePoint - parentOffset) +
+                               getCrumpleDisplacement(seed, latticePoint + parentOffset)) * 0.5;
+    vec3 displacement = mix(parentDisplacement, ownDisplacement, lodMorph) * size.x;
+    vec3 vertex = vec3(position.xy * size, position.z) + displacement * (1.0 - homeness);
+    vec4 worldPosition = vec4(rotate(instanceOrientation, vertex) + instancePositionAndSeed.xyz, 1.0);
+
+    gl_Position = modelViewProjectionMatrix * worldPosition;
+
+    float y = gl_Position.y;
+    float distanceNormalised = (y-topLightEndY)/(toplightStartY-topLightEndY);
+    brightness = ambientLight + toplightIntensity * distanceNormalised;
+
+    texCoordVarying = mix(instanceTexCoordRect.xy, instanceTexCoordRect.zw, texcoord);
+}
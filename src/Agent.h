@@ -1,18 +1,22 @@
 #pragma once
 
 #include "ofMain.h"
-#include "Visualisation.h"
+#include "AgentStore.h"
+#include "ContourPath.h"
+#include "SpatialHash.h"
 
 // Move data for agents to use as they wish.
 struct MoveData {
     float normalisedValue1;
     float normalisedValue2;
     float globalScaling = 1.f;
+    // Everyone's positions as of the start of the update, for finding neighbours. May be null.
+    const SpatialHash * spatialHash = nullptr;
 };
 
 // Agent base class. Responsible for calculating its position and orientation.
 // Derived classes are free to specialise positioning/orientation rules.
-// Owns a visualisation.
+// Agents don't draw; Agents draws each visualisation at its agent's transform.
 class Agent {
 public:
     virtual void setup(){
@@ -20,32 +24,19 @@ public:
         position = ofVec3f(0, 0, 0);
     }
     
-    virtual void setVisualisation(unique_ptr<Visualisation> visualisation){
-        this->visualisation = std::move(visualisation);
-    }
+    virtual void update(MoveData &moveData) = 0;
     
-    virtual unique_ptr<Visualisation> getVisualisation(){
-        return std::move(this->visualisation);
+    // Hands this agent's movement state over to the store so that it can be updated in a
+    // batch with other agents of its type. Once added, the agent's position lives in the
+    // store. Returns false if the agent can only be updated through update().
+    virtual bool addToStore(AgentStore &store, size_t index){
+        return false;
     }
     
-    virtual void update(MoveData &moveData) = 0;
-    
     virtual void setSpeed(float normalisedValue){
         speed = ofMap(normalisedValue, 0.f, 1.f, MinSpeed, MaxSpeed);
     }
 
-    virtual void draw(){
-        visualisation->draw(position, orientationEuler);
-    }
-    
-    virtual void drawUntextured(){
-        visualisation->drawUntextured(position, orientationEuler);
-    }
-    
-    virtual void bringVisualisationHome(float normalisedHomeness){
-        visualisation->bringItHome(normalisedHomeness);
-    }
-    
     ofVec3f getPosition() const{
         return position;
     }
@@ -55,10 +46,9 @@ public:
     }
     
 protected:
-    constexpr static float MinSpeed = .5f;
-    constexpr static float MaxSpeed = 10.f;
+    constexpr static float MinSpeed = AgentStore::MinSpeed;
+    constexpr static float MaxSpeed = AgentStore::MaxSpeed;
 
-    unique_ptr<Visualisation> visualisation;
     float minSpeed, maxSpeed, speed;
     ofVec3f position, orientationEuler;
 };
@@ -91,20 +81,8 @@ public:
         } else if (pos.y > ofGetHeight()/2){
             pos.y = -ofGetHeight()/2;
         }
-    }
-    
-    virtual void draw() override{
-        ofPushStyle();
-        float arrowLength = 30.f;
-        
-        ofPoint arrow(sin(ori), cos(ori));
-        arrow *= arrowLength;
         
-        ofPoint arrowTip(pos + arrow);
-        ofSetColor(ofMap(speed, minSpeed, maxSpeed, 255, 100), 100, ofMap(speed, minSpeed, maxSpeed, 100, 255));
-        ofFill();
-        ofDrawLine(pos.x, pos.y, arrowTip.x, arrowTip.y);
-        ofPopStyle();
+        position = pos;
     }
     
     float ori;
@@ -140,6 +118,12 @@ public:
         calculatePosition();
     }
     
+    virtual bool addToStore(AgentStore &store, size_t index) override{
+        store.setTransform(index, position, orientationEuler);
+        store.addSphereAgent(index, angleZ, angleY, directionalAngle, sphereRadius);
+        return true;
+    }
+    
     virtual ofVec3f calculatePosition(){
         ofVec3f v(1, 0, 0);
         
@@ -148,6 +132,8 @@ public:
         v.scale(sphereRadius);
         
         position = v;
+        
+        return position;
     }
 
 protected:
@@ -166,6 +152,12 @@ class PivotingSphereRovingAgent : public SphereRovingAgent {
         orientationEuler.y = angleY;
         orientationEuler.z = angleZ;
     }
+    
+    virtual bool addToStore(AgentStore &store, size_t index) override{
+        store.setTransform(index, position, orientationEuler);
+        store.addPivotingSphereAgent(index, angleZ, angleY, directionalAngle, sphereRadius);
+        return true;
+    }
 };
 
 // An agent that roves around the vertices in a mesh.
@@ -179,8 +171,20 @@ public:
         this->mesh = mesh;
     }
     
+    // With a contour path the agent traces the letter's outline instead of hopping between
+    // the mesh's vertices: it just advances along the path by its speed.
+    void setContourPath(shared_ptr<const ContourPath> contourPath){
+        this->contourPath = contourPath;
+    }
+    
     virtual void setup() override{
         Agent::setup();
+        
+        if (hasContourPath()){
+            pathPosition = ofRandom(contourPath->getLength());
+            position = contourPath->getPointAt(pathPosition);
+            return;
+        }
 
         ofIndexType positionIndexIndex = ofRandom(mesh->getNumIndices());
         position = mesh->getVertex(mesh->getIndex(positionIndexIndex));
@@ -200,6 +204,12 @@ public:
         }
         
         setSpeed(moveData.normalisedValue2);
+        
+        if (hasContourPath()){
+            pathPosition = contourPath->wrap(pathPosition + speed);
+            position = contourPath->getPointAt(pathPosition);
+            return;
+        }
 
         float distance = position.distance(target);
         
@@ -210,7 +220,26 @@ public:
         position = position + speed * (target - position).getNormalized();
     }
     
+    virtual bool addToStore(AgentStore &store, size_t index) override{
+        if (mesh == nullptr){
+            return false;
+        }
+        
+        store.setTransform(index, position, orientationEuler);
+        
+        if (hasContourPath()){
+            store.addContourAgent(index, contourPath, pathPosition);
+        }else{
+            store.addMeshAgent(index, mesh, targetIndexIndex, target, MinimumDistance);
+        }
+        return true;
+    }
+    
 protected:
+    bool hasContourPath() const{
+        return contourPath != nullptr && !contourPath->isEmpty();
+    }
+    
     void getRandomTarget(){
         ofIndexType indexIndex;
         
@@ -241,6 +270,8 @@ protected:
     ofVec3f target;
     ofIndexType targetIndexIndex;     // index into the indices vector of the mesh
                                         // for the current position
+    shared_ptr<const ContourPath> contourPath;
+    float pathPosition;                 // distance along the contour path
 };
 
 // An agent that roves around vertices.
@@ -250,25 +281,26 @@ public:
         this->MinimumDistance = minimumDistance;
     }
     
-    void setVertices(vector<ofVec3f> points){
+    // Points are shared between agents and never modified.
+    void setVertices(shared_ptr<const vector<ofVec3f>> points){
         this->points = points;
     }
     
     virtual void setup() override{
         Agent::setup();
         
-        if (points.size() == 0){
+        if (points == nullptr || points->size() == 0){
             return;
         }
         
-        index = ofRandom(points.size());
-        position = points[index];
+        index = ofRandom(points->size());
+        position = (*points)[index];
         
         nextTarget();
     }
     
     virtual void update(MoveData &moveData) override{
-        if (points.size() == 0){
+        if (points == nullptr || points->size() == 0){
             return;
         }
         
@@ -283,18 +315,28 @@ public:
         position = position + speed * (target - position).getNormalized();
     }
     
+    virtual bool addToStore(AgentStore &store, size_t index) override{
+        if (points == nullptr || points->size() == 0){
+            return false;
+        }
+        
+        store.setTransform(index, position, orientationEuler);
+        store.addVerticesAgent(index, points, this->index, target, MinimumDistance);
+        return true;
+    }
+    
 protected:
     void nextTarget(){
         index++;
         
-        if (index == points.size()){
+        if (index == points->size()){
             index = 0;
         }
         
-        target = points[index];
+        target = (*points)[index];
     }
     
-    vector<ofVec3f> points;
+    shared_ptr<const vector<ofVec3f>> points;
     int index;
     float MinimumDistance;
     ofVec3f target;
@@ -330,6 +372,12 @@ public:
         position = position + speed * (target - position).getNormalized();
     }
     
+    virtual bool addToStore(AgentStore &store, size_t index) override{
+        store.setTransform(index, position, orientationEuler);
+        store.addBoundAgent(index, boundingBox, target, MinimumDistance);
+        return true;
+    }
+    
 protected:
     ofVec3f getRandomPosition(){
         return ofVec3f(ofRandom(boundingBox.getMinX(), boundingBox.getMaxX()), ofRandom(boundingBox.getMaxY(), boundingBox.getMinY()), 0);
@@ -340,28 +388,6 @@ protected:
     ofRectangle boundingBox;
 };
 
-// Linearly interpolates position from a start position to an end position.
-// Expects the normalised lerp value to be MoveData::normalisedValue1
-class LerpingAgent : public Agent {
-public:
-    void setStartPosition(ofVec3f startPosition){
-        this->startPosition = startPosition;
-    }
-    
-    void setEndPosition(ofVec3f endPosition){
-        this->endPosition = endPosition;
-    }
-    
-    virtual void update(MoveData &moveData) override{
-        position = startPosition + (endPosition - startPosition) * moveData.normalisedValue1;
-    }
-    
-protected:
-    ofVec3f startPosition;
-    ofVec3f endPosition;
-    float startTime, endTime;
-};
-
 class StaticAgent : public Agent {
 public:
     void setPosition(ofVec3f position){
@@ -377,4 +403,10 @@ public:
     
     virtual void update(MoveData &moveData) override{
     }
+    
+    virtual bool addToStore(AgentStore &store, size_t index) override{
+        store.setTransform(index, position, orientationEuler);
+        store.addStaticAgent(index);
+        return true;
+    }
 };
\ No newline at end of file
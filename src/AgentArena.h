@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <utility>
+#include <algorithm>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+
+// Contiguous storage for agents. Objects are constructed one after another into large
+// blocks, so creating thousands of agents costs a handful of allocations. Objects can't be
+// freed individually; they all live until clear() or the arena's destruction, which run
+// their destructors. Blocks are kept by clear() and reused.
+class AgentArena {
+public:
+    AgentArena() = default;
+    AgentArena(const AgentArena &) = delete;
+    AgentArena & operator=(const AgentArena &) = delete;
+
+    ~AgentArena(){
+        clear();
+    }
+
+    template <class T, class... Args>
+    T * create(Args &&... args){
+        static_assert(alignof(T) <= alignof(std::max_align_t), "AgentArena can't align over-aligned types");
+
+        T * object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        destructors.push_back({ object, [](void * p){ static_cast<T *>(p)->~T(); } });
+        return object;
+    }
+
+    // Destroys every object, newest first, and rewinds to the first block.
+    void clear(){
+        for (auto it=destructors.rbegin(); it!=destructors.rend(); ++it){
+            it->destroy(it->object);
+        }
+
+        destructors.clear();
+        blockIndex = 0;
+        blockOffset = 0;
+    }
+
+protected:
+    const static size_t BlockSize = 64 * 1024;
+
+    struct Destructor {
+        void * object;
+        void (*destroy)(void *);
+    };
+
+    struct Block {
+        std::unique_ptr<unsigned char[]> bytes;
+        size_t size;
+    };
+
+    void * allocate(size_t size, size_t alignment){
+        while (blockIndex < blocks.size()){
+            Block & block = blocks[blockIndex];
+            uintptr_t base = reinterpret_cast<uintptr_t>(block.bytes.get());
+            uintptr_t aligned = (base + blockOffset + alignment - 1) & ~uintptr_t(alignment - 1);
+
+            if (aligned + size <= base + block.size){
+                blockOffset = aligned + size - base;
+                return reinterpret_cast<void *>(aligned);
+            }
+
+            blockIndex++;
+            blockOffset = 0;
+        }
+
+        // new[] returns memory aligned for any fundamental type.
+        size_t blockSize = std::max(BlockSize, size);
+        blocks.push_back({ std::unique_ptr<unsigned char[]>(new unsigned char[blockSize]), blockSize });
+        blockOffset = size;
+        return blocks.back().bytes.get();
+    }
+
+    std::vector<Block> blocks;
+    size_t blockIndex = 0;
+    size_t blockOffset = 0;
+    std::vector<Destructor> destructors;
+};
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "ofMain.h"
+#include "Simd.h"
+#include <array>
+
+// Decides which agents need drawing from bounding spheres, eight agents at a time. An agent
+// is culled if its sphere is entirely outside the view frustum, or entirely inside the
+// space an occluder (a flat, opaque quad such as the poster) hides from the eye: behind the
+// quad and within the pyramid from the eye through its edges.
+class AgentCuller {
+public:
+    struct Stats {
+        size_t numTested = 0;
+        size_t numOutsideFrustum = 0;
+        size_t numOccluded = 0;
+
+        size_t getNumDrawn() const{
+            return numTested - numOutsideFrustum - numOccluded;
+        }
+    };
+
+    // Takes the frustum and the eye from model view and projection matrices in
+    // openFrameworks' row vector convention (clip = vertex * modelView * projection), e.g.
+    // the current ones while drawing.
+    void setView(const ofMatrix4x4 & modelView, const ofMatrix4x4 & projection){
+        ofMatrix4x4 modelViewProjection = modelView * projection;
+
+        for (int axis=0; axis<3; axis++){
+            frustumPlanes[axis * 2] = getPlane(modelViewProjection, axis, 1.f);
+            frustumPlanes[axis * 2 + 1] = getPlane(modelViewProjection, axis, -1.f);
+        }
+
+        eye = modelView.getInverse().getTranslation();
+    }
+
+    // corners go round the quad. Whether agents behind it are hidden is worked out in
+    // cull() from the eye at the time.
+    void setOccluder(const array<ofVec3f, 4> & corners){
+        occluderCorners = corners;
+        hasOccluder = true;
+    }
+
+    void clearOccluder(){
+        hasOccluder = false;
+    }
+
+    // Sets isVisible[i] for every increment-th agent and leaves the others alone.
+    void cull(const vector<ofVec3f> & positions, const vector<float> & radii, size_t increment, bool isOccluderUsed, vector<uint8_t> & isVisible){
+        isVisible.resize(positions.size());
+
+        bool isOccluding = isOccluderUsed && hasOccluder && setUpOccluderPlanes();
+        size_t numAgents = (positions.size() + increment - 1) / increment;
+        stats = Stats();
+        stats.numTested = numAgents;
+
+        for (size_t first=0; first<numAgents; first+=Float8::Width){
+            float xs[Float8::Width], ys[Float8::Width], zs[Float8::Width], rs[Float8::Width];
+            size_t count = min<size_t>(Float8::Width, numAgents - first);
+
+            for (size_t k=0; k<Float8::Width; k++){
+                size_t i = (first + min(k, count - 1)) * increment;
+                xs[k] = positions[i].x;
+                ys[k] = positions[i].y;
+                zs[k] = positions[i].z;
+                rs[k] = radii[i];
+            }
+
+            Float8 x = Float8::load(xs), y = Float8::load(ys), z = Float8::load(zs), r = Float8::load(rs);
+
+            // The smallest signed distance to a plane, less the radius for the occluder,
+            // where the sphere has to be inside by a margin.
+            float frustumDistances[Float8::Width], occluderDistances[Float8::Width];
+            getMinimumDistance(frustumPlanes, 6, x, y, z, r).store(frustumDistances);
+
+            if (isOccluding){
+                getMinimumDistance(occluderPlanes, 5, x, y, z, Float8::broadcast(0.f) - r).store(occluderDistances);
+            }
+
+            for (size_t k=0; k<count; k++){
+                bool isInsideFrustum = frustumDistances[k] >= 0.f;
+                bool isOccluded = isInsideFrustum && isOccluding && occluderDistances[k] >= 0.f;
+
+                isVisible[(first + k) * increment] = isInsideFrustum && !isOccluded;
+                stats.numOutsideFrustum += !isInsideFrustum;
+                stats.numOccluded += isOccluded;
+            }
+        }
+    }
+
+    // From the last cull().
+    const Stats & getStats() const{
+        return stats;
+    }
+
+protected:
+    // Plane (a, b, c, d) with a * x + b * y + c * z + d >= 0 on the inside. Normalised, so
+    // that this is the distance.
+    static ofVec4f getNormalisedPlane(ofVec3f normal, float d){
+        float length = normal.length();
+        return length > 0.f ? ofVec4f(normal.x / length, normal.y / length, normal.z / length, d / length) : ofVec4f(0, 0, 0, 1);
+    }
+
+    // The frustum side where clip[axis] = sign * clip.w.
+    static ofVec4f getPlane(const ofMatrix4x4 & m, int axis, float sign){
+        ofVec3f normal(m(0, 3) + sign * m(0, axis), m(1, 3) + sign * m(1, axis), m(2, 3) + sign * m(2, axis));
+        return getNormalisedPlane(normal, m(3, 3) + sign * m(3, axis));
+    }
+
+    static ofVec4f getPlaneThrough(ofVec3f a, ofVec3f b, ofVec3f c, ofVec3f inside){
+        ofVec3f normal = (b - a).getCrossed(c - a);
+        if (normal.dot(inside - a) < 0.f){
+            normal = -normal;
+        }
+        return getNormalisedPlane(normal, -normal.dot(a));
+    }
+
+    static Float8 getMinimumDistance(const ofVec4f * planes, int numPlanes, Float8 x, Float8 y, Float8 z, Float8 r){
+        Float8 minimum = Float8::broadcast(numeric_limits<float>::max());
+
+        for (int p=0; p<numPlanes; p++){
+            Float8 distance = x * planes[p].x + y * planes[p].y + z * planes[p].z + planes[p].w;
+            minimum = Float8::min(minimum, distance + r);
+        }
+
+        return minimum;
+    }
+
+    // The hidden space is the pyramid from the eye through the occluder, beyond it. Returns
+    // false if the eye is (nearly) in the occluder's plane, where it hides nothing.
+    bool setUpOccluderPlanes(){
+        ofVec3f center = (occluderCorners[0] + occluderCorners[1] + occluderCorners[2] + occluderCorners[3]) / 4.f;
+        ofVec3f normal = (occluderCorners[1] - occluderCorners[0]).getCrossed(occluderCorners[2] - occluderCorners[0]).getNormalized();
+        float eyeDistance = normal.dot(eye - center);
+
+        if (fabs(eyeDistance) < MinimumEyeDistance){
+            return false;
+        }
+
+        // A point inside the hidden space: on the line from the eye through the center,
+        // past the occluder.
+        ofVec3f beyond = center + (center - eye);
+
+        for (int i=0; i<4; i++){
+            occluderPlanes[i] = getPlaneThrough(eye, occluderCorners[i], occluderCorners[(i + 1) % 4], beyond);
+        }
+        occluderPlanes[4] = getPlaneThrough(occluderCorners[0], occluderCorners[1], occluderCorners[2], beyond);
+
+        return true;
+    }
+
+    const float MinimumEyeDistance = 1.f;
+
+    ofVec4f frustumPlanes[6];
+    ofVec4f occluderPlanes[5];
+    ofVec3f eye;
+    array<ofVec3f, 4> occluderCorners;
+    bool hasOccluder = false;
+    Stats stats;
+};
@@ -1,13 +1,42 @@
 #pragma once
 
 #include "Agent.h"
+#include "AgentArena.h"
+#include "GlyphCache.h"
 #include <vector>
 
+// Creates agents. Sources that configure their agents (with meshes, positions etc.) do so
+// in configureAgent() so that Agents can reuse agents it created earlier instead of
+// allocating new ones: configureAgent() may be passed any agent previously returned by
+// the same source's getAgent() or getAgents().
 class AgentSource {
 public:
     virtual void setup() = 0;
     virtual void reset() {};
     virtual unique_ptr<Agent> getAgent() = 0;
+    
+    // Constructs up to count configured agents in arena, writing pointers to them to agents.
+    // Returns how many were created, which is 0 if the source isn't ready to create any.
+    virtual size_t getAgents(size_t count, AgentArena &arena, Agent **agents) = 0;
+    
+    // Whether the source has what it needs (e.g. letters) to create and configure agents.
+    // configureAgent() must only be called on a ready source.
+    virtual bool isReady() const{
+        return true;
+    }
+    
+    virtual void configureAgent(Agent &agent) {};
+    
+protected:
+    template <class T>
+    size_t createAgents(size_t count, AgentArena &arena, Agent **agents){
+        for (size_t i = 0; i < count; i++){
+            agents[i] = arena.create<T>();
+            configureAgent(*agents[i]);
+        }
+        
+        return count;
+    }
 };
 
 class SphereRovingAgentSource : public AgentSource {
@@ -18,6 +47,10 @@ public:
     unique_ptr<Agent> getAgent() override{
         return move(make_unique<SphereRovingAgent>());
     }
+    
+    size_t getAgents(size_t count, AgentArena &arena, Agent **agents) override{
+        return createAgents<SphereRovingAgent>(count, arena, agents);
+    }
 };
 
 class PivotingSphereRovingAgentSource : public AgentSource {
@@ -28,6 +61,10 @@ public:
     unique_ptr<Agent> getAgent() override{
         return move(make_unique<PivotingSphereRovingAgent>());
     }
+    
+    size_t getAgents(size_t count, AgentArena &arena, Agent **agents) override{
+        return createAgents<PivotingSphereRovingAgent>(count, arena, agents);
+    }
 };
 
 class TextRovingAgentSource : public AgentSource {
@@ -39,6 +76,7 @@ public:
         auto correctionDueToBadTessellation = 7.f;
         
         letterMeshes.clear();
+        letterContourPaths.clear();
         
         for (auto i=0; i<letterPaths.size(); ++i){
             shared_ptr<ofMesh> mesh = make_shared<ofMesh>(letterPaths[i].getTessellation());
@@ -51,6 +89,20 @@ public:
         }
     }
     
+    // Same as setLetterPaths() with letters that are already tessellated, see Text::getLetters().
+    // Agents trace the letters' contour paths.
+    void setLetters(const vector<GlyphCache::Letter> &letters){
+        letterMeshes.clear();
+        letterContourPaths.clear();
+        
+        for (auto &letter : letters){
+            if (letter.mesh->getNumVertices() > 0){
+                letterMeshes.push_back(letter.mesh);
+                letterContourPaths.push_back(letter.contourPath);
+            }
+        }
+    }
+    
     virtual unique_ptr<Agent> getAgent() override{
         if (letterMeshes.size() == 0){
             ofLogWarning() << "TextRovingAgentSource::letterMeshes.size() == 0" << endl;
@@ -58,14 +110,36 @@ public:
         }
         
         unique_ptr<MeshRovingAgent> agent = make_unique<MeshRovingAgent>();
-        agent->setMesh(letterMeshes[ofRandom(letterMeshes.size())]);
-        agent->setMinimumDistance(10.f);
+        configureAgent(*agent);
         
         return move(agent);
     }
     
+    virtual size_t getAgents(size_t count, AgentArena &arena, Agent **agents) override{
+        if (letterMeshes.size() == 0){
+            ofLogWarning() << "TextRovingAgentSource::letterMeshes.size() == 0" << endl;
+            return 0;
+        }
+        
+        return createAgents<MeshRovingAgent>(count, arena, agents);
+    }
+    
+    virtual bool isReady() const override{
+        return letterMeshes.size() > 0;
+    }
+    
+    virtual void configureAgent(Agent &agent) override{
+        MeshRovingAgent &meshRovingAgent = static_cast<MeshRovingAgent &>(agent);
+        size_t letterIndex = ofRandom(letterMeshes.size());
+        meshRovingAgent.setMesh(letterMeshes[letterIndex]);
+        meshRovingAgent.setContourPath(letterIndex < letterContourPaths.size() ? letterContourPaths[letterIndex] : nullptr);
+        meshRovingAgent.setMinimumDistance(10.f);
+    }
+    
 protected:
-    vector< shared_ptr<ofMesh> > letterMeshes;
+    vector< shared_ptr<const ofMesh> > letterMeshes;
+    // Parallel to letterMeshes when set through setLetters(), empty otherwise.
+    vector< shared_ptr<const ContourPath> > letterContourPaths;
     
     void setMeshPosition(shared_ptr<ofMesh> mesh, ofVec2f position){
         for (int i=0; i<mesh->getNumVertices(); i++){
@@ -85,12 +159,21 @@ public:
 
     virtual unique_ptr<Agent> getAgent() override{
         unique_ptr<BasicBoundAgent> agent = make_unique<BasicBoundAgent>();
-        agent->setMinimumDistance(10.f);
-        agent->setBoundingBox(this->boundingBox);
+        configureAgent(*agent);
         
         return move(agent);
     }
     
+    virtual size_t getAgents(size_t count, AgentArena &arena, Agent **agents) override{
+        return createAgents<BasicBoundAgent>(count, arena, agents);
+    }
+    
+    virtual void configureAgent(Agent &agent) override{
+        BasicBoundAgent &basicBoundAgent = static_cast<BasicBoundAgent &>(agent);
+        basicBoundAgent.setMinimumDistance(10.f);
+        basicBoundAgent.setBoundingBox(this->boundingBox);
+    }
+    
 protected:
     ofRectangle boundingBox;
 };
@@ -107,12 +190,26 @@ public:
         }
         
         unique_ptr<StaticAgent> agent = make_unique<StaticAgent>();
-        ofVec3f vertex = getRandomVertexFromRandomLetter();
-        agent->setPosition(vertex);
+        configureAgent(*agent);
         
         return move(agent);
     }
     
+    virtual size_t getAgents(size_t count, AgentArena &arena, Agent **agents) override{
+        if (letterMeshes.size() == 0){
+            ofLogWarning() << "TextSittingAgentSource::letterMeshes.size() == 0. Probably forgot to call TextRovingAgentSource::setup()" << endl;
+            return 0;
+        }
+        
+        return createAgents<StaticAgent>(count, arena, agents);
+    }
+    
+    virtual void configureAgent(Agent &agent) override{
+        StaticAgent &staticAgent = static_cast<StaticAgent &>(agent);
+        ofVec3f vertex = getRandomVertexFromRandomLetter();
+        staticAgent.setPosition(vertex);
+    }
+    
 protected:
     ofVec3f getRandomVertexFromRandomLetter(){
         shared_ptr<const ofMesh> mesh = letterMeshes[ofRandom(letterMeshes.size())];
@@ -153,16 +250,27 @@ public:
     }
     
     virtual unique_ptr<Agent> getAgent() override{
+        unique_ptr<StaticAgent> agent = make_unique<StaticAgent>();
+        configureAgent(*agent);
+        
+        return move(agent);
+    }
+    
+    virtual size_t getAgents(size_t count, AgentArena &arena, Agent **agents) override{
+        return createAgents<StaticAgent>(count, arena, agents);
+    }
+    
+    virtual void configureAgent(Agent &agent) override{
         if (rowIndex >= rows){
             ofLogWarning() << "GridAgentSource::getAgent() Can't return any more Agents. "
             << "Have done the whole grid. (rowIndex >= rows)" << endl;
         }
 
-        unique_ptr<StaticAgent> agent = make_unique<StaticAgent>();
+        StaticAgent &staticAgent = static_cast<StaticAgent &>(agent);
         ofVec3f agentRelativePosition(colIndex * colWidth - ((cols-1) * colWidth / 2.f), -rowIndex * rowHeight + ((rows-1) * rowHeight / 2.f), 0.f);
         agentRelativePosition.rotate(this->orientationEuler.x, this->orientationEuler.y, this->orientationEuler.z);
-        agent->setPosition(this->position + agentRelativePosition);
-        agent->setOrientationEuler(orientationEuler);
+        staticAgent.setPosition(this->position + agentRelativePosition);
+        staticAgent.setOrientationEuler(orientationEuler);
         
         colIndex++;
         
@@ -170,8 +278,6 @@ public:
             colIndex = 0;
             rowIndex++;
         }
-        
-        return move(agent);
     }
     
 protected:
@@ -194,34 +300,61 @@ public:
     void setLetterPaths(vector<ofPath> letterPaths, ofVec2f position){
         auto correctionDueToBadTessellation = 7.f;
         
+        // Agents still using the previous letters keep them alive.
+        textPoints.clear();
+        
         for (auto i=0; i<letterPaths.size(); ++i){
             ofMesh mesh = letterPaths[i].getTessellation();
             if (mesh.getNumVertices() < 2){
                 continue;
             }
             
-            vector<ofVec3f> letterPoints;
+            shared_ptr< vector<ofVec3f> > letterPoints = make_shared< vector<ofVec3f> >();
             
             ofVec3f lastLetterPoint = mesh.getVertex(0);
-            letterPoints.emplace_back(lastLetterPoint);
+            letterPoints->emplace_back(lastLetterPoint);
             
             for (ofIndexType j=1; j<mesh.getNumVertices(); ++j){
                 auto d = lastLetterPoint.distance(mesh.getVertex(j));
                 if ( d > minPointDistance ){
                     ofVec3f point = mesh.getVertex(j);
 
-                    letterPoints.emplace_back(point);
+                    letterPoints->emplace_back(point);
                     lastLetterPoint = point;
                 }
             }
             
             auto correction = position - ofVec2f(i * correctionDueToBadTessellation);
             
-            for (auto it=letterPoints.begin(); it!=letterPoints.end(); ++it){
+            for (auto it=letterPoints->begin(); it!=letterPoints->end(); ++it){
+                it->set(*it + correction);
+            }
+            
+            textPoints.emplace_back(move(letterPoints));
+        }
+    }
+    
+    // Same as setLetterPaths() with letters that are already tessellated, see Text::getLetters().
+    // Decimated outlines come from glyphCache, so only moving them into place is left to do.
+    void setLetters(const vector<GlyphCache::Letter> &letters, GlyphCache &glyphCache, ofVec2f position){
+        auto correctionDueToBadTessellation = 7.f;
+        
+        textPoints.clear();
+        
+        for (auto i=0; i<letters.size(); ++i){
+            shared_ptr<const vector<ofVec3f>> glyphPoints = glyphCache.getPoints(*letters[i].glyph, minPointDistance);
+            if (glyphPoints->size() < 2){
+                continue;
+            }
+            
+            ofVec3f correction = letters[i].offset + (position - ofVec2f(i * correctionDueToBadTessellation));
+            shared_ptr< vector<ofVec3f> > letterPoints = make_shared< vector<ofVec3f> >(*glyphPoints);
+            
+            for (auto it=letterPoints->begin(); it!=letterPoints->end(); ++it){
                 it->set(*it + correction);
             }
             
-            textPoints.emplace_back(letterPoints);
+            textPoints.emplace_back(move(letterPoints));
         }
     }
     
@@ -232,16 +365,35 @@ public:
         }
         
         unique_ptr<VerticesRovingAgent> agent = make_unique<VerticesRovingAgent>();
-        agent->setVertices(textPoints[ofRandom(textPoints.size())]);
-        agent->setMinimumDistance(10.f);
+        configureAgent(*agent);
         
         return move(agent);
         
         return nullptr;
     }
     
+    virtual size_t getAgents(size_t count, AgentArena &arena, Agent **agents) override{
+        if (textPoints.size() == 0){
+            ofLogWarning() << "SimplerTextRovingAgentSource::lettersPoints.size() == 0" << endl;
+            return 0;
+        }
+        
+        return createAgents<VerticesRovingAgent>(count, arena, agents);
+    }
+    
+    virtual bool isReady() const override{
+        return textPoints.size() > 0;
+    }
+    
+    virtual void configureAgent(Agent &agent) override{
+        VerticesRovingAgent &verticesRovingAgent = static_cast<VerticesRovingAgent &>(agent);
+        verticesRovingAgent.setVertices(textPoints[ofRandom(textPoints.size())]);
+        verticesRovingAgent.setMinimumDistance(10.f);
+    }
+    
 protected:
-    vector< vector<ofVec3f> > textPoints;
+    // One immutable point set per letter, shared by every agent roving it.
+    vector< shared_ptr<const vector<ofVec3f>> > textPoints;
     float minPointDistance;
     
     void setMeshPosition(shared_ptr<ofMesh> mesh, ofVec2f position){
@@ -0,0 +1,556 @@
+#pragma once
+
+#include "ofMain.h"
+#include "Simd.h"
+#include "WorkerPool.h"
+#include "ContourPath.h"
+#include "SpatialHash.h"
+
+// Structure-of-arrays storage for agent state. Transforms and speeds live in contiguous
+// arrays indexed by agent, and the movement state of each agent type lives in its own
+// bucket so that every type is updated in one tight loop without virtual calls.
+// Agents that can't be expressed in a bucket stay outside the store and are updated
+// through Agent::update() as before; their transforms are copied in with setTransform().
+// Updates can be spread over a WorkerPool. Buckets are cut into chunks aligned to the
+// Float8 width and bound agents draw from their own random sequences, so a parallel
+// update gives exactly the same result as a serial one.
+// With separation turned on, sphere and bound agents steer away from neighbours found in
+// a SpatialHash of the previous positions. That is worked out for every agent before any
+// of them moves, so it doesn't depend on the update order either.
+class AgentStore {
+public:
+    constexpr static float MinSpeed = .5f;
+    constexpr static float MaxSpeed = 10.f;
+
+    // Removes all agents but keeps the allocated capacity.
+    void clear(){
+        positions.clear();
+        steerings.clear();
+        separations.clear();
+        orientationsEuler.clear();
+        speeds.clear();
+        isInBucket.clear();
+        sphereBucket.clear();
+        pivotingSphereBucket.clear();
+        meshBucket.clear();
+        contourBucket.clear();
+        verticesBucket.clear();
+        boundBucket.clear();
+        staticIndices.clear();
+    }
+
+    void resize(size_t numAgents){
+        positions.resize(numAgents);
+        orientationsEuler.resize(numAgents);
+        speeds.resize(numAgents, 0.f);
+        isInBucket.resize(numAgents, false);
+        steerings.resize(numAgents, 0.f);
+        separations.resize(numAgents);
+    }
+
+    // Agents within radius of each other push apart. weight is how much of the way a sphere
+    // agent turns towards the direction away from its neighbours each update, and how
+    // strongly a bound agent is pushed relative to the pull of its target. 0 turns it off.
+    void setSeparation(float radius, float weight){
+        separationRadius = radius;
+        separationWeight = weight;
+    }
+
+    size_t size() const{
+        return positions.size();
+    }
+
+    void setTransform(size_t index, ofVec3f position, ofVec3f orientationEuler){
+        positions[index] = position;
+        orientationsEuler[index] = orientationEuler;
+    }
+
+    ofVec3f getPosition(size_t index) const{
+        return positions[index];
+    }
+
+    ofVec3f getOrientationEuler(size_t index) const{
+        return orientationsEuler[index];
+    }
+
+    const vector<ofVec3f> & getPositions() const{
+        return positions;
+    }
+
+    const vector<ofVec3f> & getOrientationsEuler() const{
+        return orientationsEuler;
+    }
+
+    // Whether the agent at index is updated by the store, i.e. doesn't need Agent::update().
+    bool isInStore(size_t index) const{
+        return isInBucket[index];
+    }
+
+    void addSphereAgent(size_t index, float angleZ, float angleY, float directionalAngle, float sphereRadius){
+        sphereBucket.add(index, angleZ, angleY, directionalAngle, sphereRadius);
+        isInBucket[index] = true;
+    }
+
+    void addPivotingSphereAgent(size_t index, float angleZ, float angleY, float directionalAngle, float sphereRadius){
+        pivotingSphereBucket.add(index, angleZ, angleY, directionalAngle, sphereRadius);
+        isInBucket[index] = true;
+    }
+
+    void addMeshAgent(size_t index, shared_ptr<const ofMesh> mesh, ofIndexType targetIndexIndex, ofVec3f target, float minimumDistance){
+        meshBucket.indices.push_back(index);
+        meshBucket.meshes.push_back(mesh);
+        meshBucket.targetIndexIndices.push_back(targetIndexIndex);
+        meshBucket.targets.push_back(target);
+        meshBucket.minimumDistances.push_back(minimumDistance);
+        isInBucket[index] = true;
+    }
+
+    void addVerticesAgent(size_t index, shared_ptr<const vector<ofVec3f>> points, int pointIndex, ofVec3f target, float minimumDistance){
+        verticesBucket.indices.push_back(index);
+        verticesBucket.points.push_back(points);
+        verticesBucket.pointIndices.push_back(pointIndex);
+        verticesBucket.targets.push_back(target);
+        verticesBucket.minimumDistances.push_back(minimumDistance);
+        isInBucket[index] = true;
+    }
+
+    void addContourAgent(size_t index, shared_ptr<const ContourPath> contourPath, float pathPosition){
+        contourBucket.indices.push_back(index);
+        contourBucket.contourPaths.push_back(contourPath);
+        contourBucket.pathPositions.push_back(pathPosition);
+        isInBucket[index] = true;
+    }
+
+    void addBoundAgent(size_t index, ofRectangle boundingBox, ofVec3f target, float minimumDistance){
+        boundBucket.indices.push_back(index);
+        boundBucket.randomStates.push_back(uint32_t(ofRandom(1.f) * 4294967295.f) | 1u);
+        boundBucket.boundingBoxes.push_back(boundingBox);
+        boundBucket.targets.push_back(target);
+        boundBucket.minimumDistances.push_back(minimumDistance);
+        isInBucket[index] = true;
+    }
+
+    void addStaticAgent(size_t index){
+        staticIndices.push_back(index);
+        isInBucket[index] = true;
+    }
+
+    // Advances every agent in a bucket. The noise arrays are indexed by agent and
+    // play the roles of MoveData::normalisedValue1 and MoveData::normalisedValue2.
+    // Pass a pool to update the chunks of all buckets in parallel, and a spatial hash of the
+    // current positions for separation.
+    void update(const float * normalisedValues1, const float * normalisedValues2, float globalScaling, WorkerPool * pool = nullptr, const SpatialHash * spatialHash = nullptr){
+        chunks.clear();
+        addChunks(BucketType::Sphere, sphereBucket.indices.size(), SphereChunkSize);
+        addChunks(BucketType::PivotingSphere, pivotingSphereBucket.indices.size(), SphereChunkSize);
+        addChunks(BucketType::Mesh, meshBucket.indices.size(), RovingChunkSize);
+        addChunks(BucketType::Contour, contourBucket.indices.size(), RovingChunkSize);
+        addChunks(BucketType::Vertices, verticesBucket.indices.size(), RovingChunkSize);
+        addChunks(BucketType::Bound, boundBucket.indices.size(), RovingChunkSize);
+        
+        isSeparating = spatialHash != nullptr && separationWeight > 0.f;
+        
+        auto separateChunks = [&](size_t begin, size_t end){
+            for (size_t c=begin; c<end; c++){
+                separateChunk(chunks[c], *spatialHash);
+            }
+        };
+        
+        auto updateChunks = [&](size_t begin, size_t end){
+            for (size_t c=begin; c<end; c++){
+                updateChunk(chunks[c], normalisedValues1, normalisedValues2, globalScaling);
+            }
+        };
+        
+        if (pool != nullptr){
+            if (isSeparating){
+                pool->parallelFor(chunks.size(), 1, separateChunks);
+            }
+            pool->parallelFor(chunks.size(), 1, updateChunks);
+        }else{
+            if (isSeparating){
+                separateChunks(0, chunks.size());
+            }
+            updateChunks(0, chunks.size());
+        }
+    }
+
+protected:
+    // Chunk sizes in agents. Sphere chunks must be a multiple of Float8::Width.
+    constexpr static size_t SphereChunkSize = 1024;
+    constexpr static size_t RovingChunkSize = 256;
+    constexpr static size_t MaxSeparationNeighbours = 32;
+    
+    enum class BucketType { Sphere, PivotingSphere, Mesh, Contour, Vertices, Bound };
+    
+    struct Chunk {
+        BucketType bucketType;
+        size_t begin, end;
+    };
+    
+    struct SphereBucket {
+        vector<size_t> indices;
+        vector<float> angleZ, angleY, directionalAngle, sphereRadius;
+
+        void add(size_t index, float angleZ, float angleY, float directionalAngle, float sphereRadius){
+            this->indices.push_back(index);
+            this->angleZ.push_back(angleZ);
+            this->angleY.push_back(angleY);
+            this->directionalAngle.push_back(directionalAngle);
+            this->sphereRadius.push_back(sphereRadius);
+        }
+
+        void clear(){
+            indices.clear();
+            angleZ.clear();
+            angleY.clear();
+            directionalAngle.clear();
+            sphereRadius.clear();
+        }
+    };
+
+    struct MeshBucket {
+        vector<size_t> indices;
+        vector< shared_ptr<const ofMesh> > meshes;
+        vector<ofIndexType> targetIndexIndices;
+        vector<ofVec3f> targets;
+        vector<float> minimumDistances;
+
+        void clear(){
+            indices.clear();
+            meshes.clear();
+            targetIndexIndices.clear();
+            targets.clear();
+            minimumDistances.clear();
+        }
+    };
+
+    struct ContourBucket {
+        vector<size_t> indices;
+        vector< shared_ptr<const ContourPath> > contourPaths;
+        vector<float> pathPositions;
+
+        void clear(){
+            indices.clear();
+            contourPaths.clear();
+            pathPositions.clear();
+        }
+    };
+
+    struct VerticesBucket {
+        vector<size_t> indices;
+        vector< shared_ptr<const vector<ofVec3f>> > points;
+        vector<int> pointIndices;
+        vector<ofVec3f> targets;
+        vector<float> minimumDistances;
+
+        void clear(){
+            indices.clear();
+            points.clear();
+            pointIndices.clear();
+            targets.clear();
+            minimumDistances.clear();
+        }
+    };
+
+    struct BoundBucket {
+        vector<size_t> indices;
+        vector<uint32_t> randomStates;
+        vector<ofRectangle> boundingBoxes;
+        vector<ofVec3f> targets;
+        vector<float> minimumDistances;
+
+        void clear(){
+            indices.clear();
+            randomStates.clear();
+            boundingBoxes.clear();
+            targets.clear();
+            minimumDistances.clear();
+        }
+    };
+
+    static float mapSpeed(float normalisedValue){
+        return MinSpeed + normalisedValue * (MaxSpeed - MinSpeed);
+    }
+    
+    // xorshift32 step, returning a value in [min, max).
+    static float nextRandom(uint32_t & state, float min, float max){
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return min + (state >> 8) * (1.f / 16777216.f) * (max - min);
+    }
+    
+    void addChunks(BucketType bucketType, size_t bucketSize, size_t chunkSize){
+        for (size_t begin=0; begin<bucketSize; begin+=chunkSize){
+            chunks.push_back({ bucketType, begin, min(begin + chunkSize, bucketSize) });
+        }
+    }
+    
+    // Sum of the directions away from each neighbour within separationRadius, each
+    // weighted by how close the neighbour is (1 when touching, 0 at the radius). Only the
+    // first MaxSeparationNeighbours are counted, so crowds don't make it quadratic.
+    ofVec3f getSeparation(size_t i, const SpatialHash & spatialHash) const{
+        ofVec3f position = positions[i];
+        ofVec3f separation(0, 0, 0);
+        size_t numNeighbours = 0;
+        
+        spatialHash.forEachNeighbour(position, separationRadius, [&](size_t j, ofVec3f neighbour, float distanceSquared){
+            if (j == i || distanceSquared == 0.f){
+                return true;
+            }
+            
+            float distance = sqrt(distanceSquared);
+            separation += (position - neighbour) * ((separationRadius - distance) / (separationRadius * distance));
+            return ++numNeighbours < MaxSeparationNeighbours;
+        });
+        
+        return separation;
+    }
+    
+    void separateChunk(const Chunk & chunk, const SpatialHash & spatialHash){
+        switch (chunk.bucketType){
+            case BucketType::Sphere:
+                steerSpheres(sphereBucket, chunk.begin, chunk.end, spatialHash);
+                break;
+            case BucketType::PivotingSphere:
+                steerSpheres(pivotingSphereBucket, chunk.begin, chunk.end, spatialHash);
+                break;
+            case BucketType::Bound:
+                for (size_t k=chunk.begin; k<chunk.end; k++){
+                    size_t i = boundBucket.indices[k];
+                    separations[i] = getSeparation(i, spatialHash) * separationWeight;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    
+    // Works out how far each sphere agent turns its directional angle away from its
+    // neighbours. The agent moves along sin(directionalAngle) * eZ + cos(directionalAngle) * eY,
+    // with eZ and eY the derivatives of its position (over the radius) with respect to
+    // angleZ and angleY, so heading at the angle of the separation's components along those
+    // always moves it with the separation. eY shrinks with cos(angleZ) towards the poles
+    // and flips beyond them, which angleZ wanders past freely.
+    void steerSpheres(SphereBucket & bucket, size_t begin, size_t end, const SpatialHash & spatialHash){
+        for (size_t k=begin; k<end; k++){
+            size_t i = bucket.indices[k];
+            ofVec3f separation = getSeparation(i, spatialHash);
+            
+            if (separation == ofVec3f(0, 0, 0)){
+                steerings[i] = 0.f;
+                continue;
+            }
+            
+            float angleZ = ofDegToRad(bucket.angleZ[k]);
+            float angleY = ofDegToRad(bucket.angleY[k]);
+            ofVec3f eZ(-sin(angleZ) * cos(angleY), cos(angleZ), sin(angleZ) * sin(angleY));
+            ofVec3f eY = ofVec3f(-sin(angleY), 0.f, -cos(angleY)) * cos(angleZ);
+            float alongZ = separation.dot(eZ);
+            float alongY = separation.dot(eY);
+            
+            float turn = ofWrapRadians(atan2(alongZ, alongY) - bucket.directionalAngle[k]);
+            float strength = min(sqrt(alongZ * alongZ + alongY * alongY), 1.f);
+            steerings[i] = turn * strength * separationWeight;
+        }
+    }
+    
+    void updateChunk(const Chunk & chunk, const float * normalisedValues1, const float * normalisedValues2, float globalScaling){
+        switch (chunk.bucketType){
+            case BucketType::Sphere:
+                updateSpheres(sphereBucket, false, chunk.begin, chunk.end, normalisedValues1, normalisedValues2, globalScaling);
+                break;
+            case BucketType::PivotingSphere:
+                updateSpheres(pivotingSphereBucket, true, chunk.begin, chunk.end, normalisedValues1, normalisedValues2, globalScaling);
+                break;
+            case BucketType::Mesh:
+                updateMeshes(chunk.begin, chunk.end, normalisedValues2);
+                break;
+            case BucketType::Contour:
+                updateContours(chunk.begin, chunk.end, normalisedValues2);
+                break;
+            case BucketType::Vertices:
+                updateVertices(chunk.begin, chunk.end, normalisedValues2);
+                break;
+            case BucketType::Bound:
+                updateBound(chunk.begin, chunk.end, normalisedValues2);
+                break;
+        }
+    }
+
+    // Same motion as SphereRovingAgent::update(), eight agents at a time. Rotating (1, 0, 0)
+    // by angleZ about the z axis and then by angleY about the y axis is a spherical
+    // coordinate mapping, so positions are written directly using fastSinCosTurns()
+    // instead of through two ofVec3f::rotate calls per agent.
+    void updateSpheres(SphereBucket & bucket, bool isPivoting, size_t begin, size_t end, const float * normalisedValues1, const float * normalisedValues2, float globalScaling){
+        const size_t Width = Float8::Width;
+        float values1[Width], values2[Width], directionalAngles[Width], anglesZ[Width], anglesY[Width];
+        float xs[Width], ys[Width], zs[Width], speedsOut[Width], radii[Width];
+        
+        for (size_t start=begin; start<end; start+=Width){
+            size_t count = min(end - start, Width);
+            
+            // Gather the block, padding a partial one by repeating its last agent.
+            for (size_t k=0; k<Width; k++){
+                size_t l = start + min(k, count - 1);
+                values1[k] = normalisedValues1[bucket.indices[l]];
+                values2[k] = normalisedValues2[bucket.indices[l]];
+                directionalAngles[k] = bucket.directionalAngle[l] + (isSeparating ? steerings[bucket.indices[l]] : 0.f);
+                anglesZ[k] = bucket.angleZ[l];
+                anglesY[k] = bucket.angleY[l];
+            }
+            
+            Float8 value1 = Float8::load(values1);
+            Float8 value2 = Float8::load(values2);
+            Float8 directionalAngle = Float8::load(directionalAngles) + (value1 - .5f) * float(PI / 32);
+            Float8 sinDirection, cosDirection;
+            fastSinCosTurns(directionalAngle * float(1 / TWO_PI), sinDirection, cosDirection);
+            
+            Float8 speed = value2 * (MaxSpeed - MinSpeed) + MinSpeed;
+            Float8 step = speed * float(PI / 16);
+            Float8 angleZ = Float8::load(anglesZ) + sinDirection * step;
+            Float8 angleY = Float8::load(anglesY) + cosDirection * step;
+            Float8 sphereRadius = value2 * 20.f + 200.f * globalScaling;
+            
+            Float8 sinZ, cosZ, sinY, cosY;
+            fastSinCosTurns(angleZ * (1.f / 360.f), sinZ, cosZ);
+            fastSinCosTurns(angleY * (1.f / 360.f), sinY, cosY);
+            Float8 radialZ = cosZ * sphereRadius;
+            
+            (radialZ * cosY).store(xs);
+            (sinZ * sphereRadius).store(ys);
+            (Float8::broadcast(0.f) - radialZ * sinY).store(zs);
+            speed.store(speedsOut);
+            sphereRadius.store(radii);
+            directionalAngle.store(directionalAngles);
+            angleZ.store(anglesZ);
+            angleY.store(anglesY);
+            
+            // Scatter the results back.
+            for (size_t k=0; k<count; k++){
+                size_t i = bucket.indices[start + k];
+                positions[i].set(xs[k], ys[k], zs[k]);
+                speeds[i] = speedsOut[k];
+                
+                if (isPivoting){
+                    orientationsEuler[i].x += (values1[k] - .5f) * PI / 32;
+                    orientationsEuler[i].y = anglesY[k];
+                    orientationsEuler[i].z = anglesZ[k];
+                }
+                
+                bucket.directionalAngle[start + k] = directionalAngles[k];
+                bucket.angleZ[start + k] = anglesZ[k];
+                bucket.angleY[start + k] = anglesY[k];
+                bucket.sphereRadius[start + k] = radii[k];
+            }
+        }
+    }
+
+    // Same motion as MeshRovingAgent::update().
+    void updateMeshes(size_t begin, size_t end, const float * normalisedValues2){
+        for (size_t k=begin; k<end; k++){
+            size_t i = meshBucket.indices[k];
+            float speed = mapSpeed(normalisedValues2[i]);
+
+            if (positions[i].distance(meshBucket.targets[k]) < meshBucket.minimumDistances[k]){
+                const ofMesh & mesh = *meshBucket.meshes[k];
+                ofIndexType targetIndexIndex = meshBucket.targetIndexIndices[k] + 1;
+
+                if (targetIndexIndex == mesh.getNumIndices()){
+                    targetIndexIndex = 0;
+                }
+
+                meshBucket.targetIndexIndices[k] = targetIndexIndex;
+                meshBucket.targets[k] = mesh.getVertex(mesh.getIndex(targetIndexIndex));
+            }
+
+            positions[i] += speed * (meshBucket.targets[k] - positions[i]).getNormalized();
+            speeds[i] = speed;
+        }
+    }
+
+    // Same motion as MeshRovingAgent::update() with a contour path.
+    void updateContours(size_t begin, size_t end, const float * normalisedValues2){
+        for (size_t k=begin; k<end; k++){
+            size_t i = contourBucket.indices[k];
+            const ContourPath & contourPath = *contourBucket.contourPaths[k];
+            float speed = mapSpeed(normalisedValues2[i]);
+            float pathPosition = contourPath.wrap(contourBucket.pathPositions[k] + speed);
+
+            contourBucket.pathPositions[k] = pathPosition;
+            positions[i] = contourPath.getPointAt(pathPosition);
+            speeds[i] = speed;
+        }
+    }
+
+    // Same motion as VerticesRovingAgent::update().
+    void updateVertices(size_t begin, size_t end, const float * normalisedValues2){
+        for (size_t k=begin; k<end; k++){
+            size_t i = verticesBucket.indices[k];
+            float speed = mapSpeed(normalisedValues2[i]);
+
+            if (positions[i].distance(verticesBucket.targets[k]) < verticesBucket.minimumDistances[k]){
+                const vector<ofVec3f> & points = *verticesBucket.points[k];
+                int pointIndex = verticesBucket.pointIndices[k] + 1;
+
+                if (pointIndex == points.size()){
+                    pointIndex = 0;
+                }
+
+                verticesBucket.pointIndices[k] = pointIndex;
+                verticesBucket.targets[k] = points[pointIndex];
+            }
+
+            positions[i] += speed * (verticesBucket.targets[k] - positions[i]).getNormalized();
+            speeds[i] = speed;
+        }
+    }
+
+    // Same motion as BasicBoundAgent::update(), but new targets come from the agent's own
+    // random sequence rather than ofRandom() so that chunks can run on any thread.
+    void updateBound(size_t begin, size_t end, const float * normalisedValues2){
+        for (size_t k=begin; k<end; k++){
+            size_t i = boundBucket.indices[k];
+            float speed = mapSpeed(normalisedValues2[i]);
+
+            if (positions[i].distance(boundBucket.targets[k]) < boundBucket.minimumDistances[k]){
+                const ofRectangle & boundingBox = boundBucket.boundingBoxes[k];
+                uint32_t & randomState = boundBucket.randomStates[k];
+                float x = nextRandom(randomState, boundingBox.getMinX(), boundingBox.getMaxX());
+                float y = nextRandom(randomState, boundingBox.getMaxY(), boundingBox.getMinY());
+                boundBucket.targets[k].set(x, y, 0);
+            }
+
+            ofVec3f direction = (boundBucket.targets[k] - positions[i]).getNormalized();
+            
+            if (isSeparating){
+                direction = (direction + separations[i]).getNormalized();
+            }
+
+            positions[i] += speed * direction;
+            speeds[i] = speed;
+        }
+    }
+
+    vector<ofVec3f> positions;
+    vector<ofVec3f> orientationsEuler;
+    vector<float> speeds;
+    vector<bool> isInBucket;
+
+    SphereBucket sphereBucket;
+    SphereBucket pivotingSphereBucket;
+    MeshBucket meshBucket;
+    ContourBucket contourBucket;
+    VerticesBucket verticesBucket;
+    BoundBucket boundBucket;
+    vector<size_t> staticIndices;
+    vector<Chunk> chunks;
+    
+    float separationRadius = 20.f;
+    float separationWeight = 0.f;
+    bool isSeparating = false;
+    // Per agent, filled before moving when separating.
+    vector<float> steerings;
+    vector<ofVec3f> separations;
+};
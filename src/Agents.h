@@ -2,142 +2,574 @@
 
 #include "ofMain.h"
 #include "AgentSource.h"
+#include "AgentArena.h"
 #include "VisualisationSource.h"
 #include "Agent.h"
+#include "AgentStore.h"
 #include "Visualisation.h"
+#include "WorkerPool.h"
+#include "NoiseField.h"
+#include "TripleBuffer.h"
+#include "SpatialHash.h"
+#include "InstancedSpriteRenderer.h"
+#include "AgentCuller.h"
+#include "DepthSorter.h"
+#include "FrameClock.h"
 
-// Handles setting up agents (with their visualisations), generating noise and scaling
+// A snapshot of everything needed to draw the agents, handed from the simulation thread
+// to the render thread.
+struct AgentsFrame {
+    vector<ofVec3f> positions;
+    vector<ofVec3f> orientationsEuler;
+    vector<Visualisation *> visualisations;
+    float homeness = 0.f;
+    unsigned int homenessVersion = 0;
+};
+
+// Handles setting up agents and their visualisations, generating noise and scaling
 // values for agents in the update loop and transitioning all agents from one type to another.
+// Agent transforms are kept in an AgentStore; agents that support it are updated there in
+// per-type batches and the rest go through Agent::update(). A spatial hash of the agents'
+// positions is rebuilt every update for neighbour queries; the store uses it to keep
+// agents apart (see setSeparation()) and other agents get it through MoveData.
+// Visualisations belong to Agents rather than to the agents, with visualisation i drawn at
+// the transform of agent i, so a transition only swaps the agents underneath them. Agents
+// replaced in a transition are kept per source and reconfigured by that source the next
+// time it is transitioned to, so after every source has been used once transitions don't
+// allocate. Agents are created in batches into an arena owned by Agents and live as long
+// as it does.
+// Particles the visualisations emit, if their source has any, are updated with the agents
+// and drawn once after them.
+// Each simulation step publishes an AgentsFrame through a triple buffer, which is what
+// gets drawn. Optionally the simulation runs on its own thread at a fixed tick rate, so
+// drawing never waits for it.
 class Agents {
 public:
+    ~Agents(){
+        stopThreadedSimulation();
+    }
+    
+    // Spreads noise generation, batched agent updates and transitions over numThreads
+    // threads (including the caller). Agents outside the store are still updated on the
+    // calling thread, as their update() may not be thread safe. Results don't depend on
+    // the number of threads. A quarter of the threads, at least one, go to the render
+    // thread's work (depth sorting) instead, which may run at the same time as a threaded
+    // simulation.
+    void setNumThreads(size_t numThreads){
+        size_t numDrawThreads = max<size_t>(numThreads / 4, 1);
+        workerPool.setup(max<size_t>(numThreads - numDrawThreads, 1));
+        drawPool.setup(numDrawThreads);
+    }
+    
+    // Makes agents on spheres and in bounding boxes avoid each other, see
+    // AgentStore::setSeparation(). Neighbours are looked for within radius.
+    void setSeparation(float radius, float weight){
+        lock_guard<mutex> lock(simulationMutex);
+        
+        separationRadius = radius;
+        store.setSeparation(radius, weight);
+    }
+    
+    // With a renderer that's ready, draw() draws sprites (see
+    // Visualisation::getSpriteInstance()) in draw order with instanced calls per texture,
+    // under the renderer's shader, after all other visualisations.
+    void setSpriteRenderer(InstancedSpriteRenderer * spriteRenderer){
+        this->spriteRenderer = spriteRenderer;
+    }
+    
+    // Agents whose visualisations are entirely outside the view of the current matrices
+    // aren't drawn, by draw() or drawUntextured(). On by default.
+    void setIsCulling(bool isCulling){
+        this->isCulling = isCulling;
+    }
+    
+    // An opaque quad, e.g. the poster, behind which draw() needn't draw agents. Shadows
+    // are still drawn for them by drawUntextured().
+    void setOccluder(const array<ofVec3f, 4> & corners){
+        culler.setOccluder(corners);
+    }
+    
+    void clearOccluder(){
+        culler.clearOccluder();
+    }
+    
+    // Whether draw() draws agents from the farthest to the nearest, which blending needs.
+    // On by default.
+    void setIsDepthSorting(bool isDepthSorting){
+        this->isDepthSorting = isDepthSorting;
+    }
+    
+    // How many agents the last draw() culled. drawUntextured(), e.g. for shadows, culls
+    // against another view and leaves these alone.
+    const AgentCuller::Stats & getCullStats() const{
+        return cullStats;
+    }
+    
     void setup(AgentSource &agentSource, VisualisationSource &visualisationSource, int maxAgents){
         isTransitioning = false;
+        currentAgentSource = &agentSource;
         
-        while (visualisationSource.hasMoreVisualisations() && agents.size() < maxAgents){
-            unique_ptr<Agent> agent = move(agentSource.getAgent());
-
-            agent->setVisualisation(move(visualisationSource.getVisualisation()));
+        while (visualisationSource.hasMoreVisualisations() && visualisations.size() < maxAgents){
+            visualisations.push_back(move(visualisationSource.getVisualisation()));
+        }
+        
+        agents.resize(visualisations.size());
+        size_t numAgents = agentSource.getAgents(agents.size(), agentArena, agents.data());
+        
+        if (numAgents < agents.size()){
+            ofLogWarning() << "Agents::setup() Agent source only created " << numAgents << " of " << agents.size() << " agents" << endl;
+            agents.resize(numAgents);
+            visualisations.resize(numAgents);
+        }
+        
+        for (auto agent : agents){
             agent->setup();
-            agents.push_back(move(agent));
         }
+        
+        particleSystem = visualisationSource.getParticleSystem();
+        
+        rebuildStore();
+        publishFrame();
+        frames.updateFront();
     }
 
+    // Moves the simulation onto its own thread, ticking ticksPerSecond times a second
+    // independently of the frame rate. From then on update() only hands over the scaling
+    // factor and picks up the newest frame. Transitions and visualisation animations are
+    // started under a lock, which costs the caller at most one simulation tick.
+    void startThreadedSimulation(float ticksPerSecond){
+        if (isThreaded){
+            return;
+        }
+        
+        isThreaded = true;
+        isSimulating = true;
+        
+        {
+            lock_guard<mutex> lock(simulationMutex);
+            publishFrame();
+        }
+        frames.updateFront();
+        
+        simulationThread = thread(&Agents::simulationLoop, this, ticksPerSecond);
+    }
+    
+    void stopThreadedSimulation(){
+        if (!isThreaded){
+            return;
+        }
+        
+        isSimulating = false;
+        simulationThread.join();
+        isThreaded = false;
+    }
+    
     void update(float scalingFactor){
+        if (isThreaded){
+            this->scalingFactor = scalingFactor;
+        }else{
+            simulate(scalingFactor);
+            publishFrame();
+        }
+        
+        if (frames.updateFront()){
+            applyFrameHomeness(frames.getFront());
+            updateVisualisations(frames.getFront());
+        }
+        
+        // With the draw pool, as this is the render thread.
+        if (particleSystem != nullptr){
+            particleSystem->update(FrameClock::getElapsedTimef(), &drawPool);
+        }
+    }
+    
+    void transitionAgents(AgentSource &agentSource, float durationSeconds){
+        lock_guard<mutex> lock(simulationMutex);
+        
+        if (isTransitioning){
+            return;
+        }
+        
+        // Agents reused from the pool are configured by the source, which needs to be ready
+        // even when it has nothing to create.
+        if (!agentSource.isReady()){
+            ofLogWarning() << "Agents::transitionAgents() Agent source isn't ready to configure agents" << endl;
+            return;
+        }
+        
+        // Create whatever the source's pool can't provide first, so that nothing has changed
+        // if the source can't create agents.
+        vector<Agent *> & pool = retiredAgents[&agentSource];
+        size_t numReusable = pool.size() + (&agentSource == currentAgentSource ? agents.size() : 0);
+        size_t numNewAgents = agents.size() - min(numReusable, agents.size());
+        
+        newAgents.resize(numNewAgents);
+        size_t numCreated = agentSource.getAgents(numNewAgents, agentArena, newAgents.data());
+        
+        if (numCreated < numNewAgents){
+            ofLogWarning() << "Agents::transitionAgents() Agent source only created " << numCreated << " of " << numNewAgents << " new agents" << endl;
+            pool.insert(pool.end(), newAgents.begin(), newAgents.begin() + numCreated);
+            return;
+        }
+        
+        isTransitioning = true;
+
+        // Visualisations move from where the old agents are now to wherever the new agents
+        // go. Both arrays keep their capacity between transitions.
+        transitionStartPositions.assign(store.getPositions().begin(), store.getPositions().end());
+        transitionPositions.assign(transitionStartPositions.begin(), transitionStartPositions.end());
+        
+        // Retire the current agents to their source's pool first, so that transitioning to
+        // the same source reuses them.
+        vector<Agent *> & retired = retiredAgents[currentAgentSource];
+        retired.insert(retired.end(), agents.begin(), agents.end());
+        
+        // New agents come first as the source configured them in that order.
+        for (size_t i = 0; i < agents.size(); i++){
+            if (i < numNewAgents){
+                agents[i] = newAgents[i];
+            }else{
+                agents[i] = pool.back();
+                pool.pop_back();
+                agentSource.configureAgent(*agents[i]);
+            }
+            agents[i]->setup();
+        }
+        
+        currentAgentSource = &agentSource;
+        rebuildStore();
+        
+        startTransitionTime = FrameClock::getElapsedTimef();
+        endTransitionTime = startTransitionTime + durationSeconds;
+    }
+    
+    bool getIsTransitioning(){
+        return isTransitioning;
+    }
+    
+    void animateVisualisations(float durationSeconds, float fromAnimationPosition, float toAnimationPosition){
+        lock_guard<mutex> lock(simulationMutex);
+        
+        startVisualisationTime = FrameClock::getElapsedTimef();
+        endVisualisationTime = startVisualisationTime + durationSeconds;
+        isAnimatingVisualisation = true;
+        this->fromAnimationPosition = fromAnimationPosition;
+        this->toAnimationPosition = toAnimationPosition;
+    }
+    
+    // Visualisations are drawn at the transforms of the latest frame, so agents overriding
+    // Agent::draw() aren't drawn their own way here.
+    void draw(){
+        drawFrame(frames.getFront(), true, 1);
+        
+        if (particleSystem != nullptr){
+            particleSystem->draw(&drawPool);
+        }
+    }
+    
+    void drawUntextured(int increment){
+        drawFrame(frames.getFront(), false, increment);
+    }
+    
+    // Where the agents are drawn, from the latest frame.
+    const vector<ofVec3f> & getDrawnPositions() const{
+        return frames.getFront().positions;
+    }
+    
+protected:
+    const size_t ChunkSize = 1024;
+    
+    void simulationLoop(float ticksPerSecond){
+        auto tickDuration = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(1. / ticksPerSecond));
+        auto nextTick = chrono::steady_clock::now();
+        
+        while (isSimulating){
+            {
+                lock_guard<mutex> lock(simulationMutex);
+                simulate(scalingFactor);
+                publishFrame();
+            }
+            
+            nextTick += tickDuration;
+            auto now = chrono::steady_clock::now();
+            
+            // Drop ticks rather than trying to catch up after a stall.
+            if (nextTick < now){
+                nextTick = now;
+            }
+            
+            this_thread::sleep_until(nextTick);
+        }
+    }
+    
+    void simulate(float scalingFactor){
         // Generate noise values for move data.
         float noiseScale = .5f;//ofMap(ofGetMouseX(), 0, ofGetWidth(), 0, 1.f);
-        float noiseVel = ofGetElapsedTimef();
+        float noiseVel = FrameClock::getElapsedTimef();
 
-        for (int i=0; i<agents.size(); i++){
+        noiseField1.setup(agents.size(), noiseScale, 1 * noiseScale);
+        noiseField2.setup(agents.size(), noiseScale, 1000 * noiseScale);
+        noiseField1.update(noiseVel, &workerPool);
+        noiseField2.update(noiseVel, &workerPool);
+        
+        const float * noiseValues1 = noiseField1.getValues();
+        const float * noiseValues2 = noiseField2.getValues();
+        
+        spatialHash.build(store.getPositions(), separationRadius);
+        store.update(noiseValues1, noiseValues2, .05f + scalingFactor, &workerPool, &spatialHash);
+        
+        for (auto i : agentsOutsideStore){
             MoveData md;
             
-            md.normalisedValue1 = ofNoise(i * noiseScale, 1 * noiseScale, noiseVel);
-            md.normalisedValue2 = ofNoise(i * noiseScale, 1000 * noiseScale, noiseVel);
+            md.normalisedValue1 = noiseValues1[i];
+            md.normalisedValue2 = noiseValues2[i];
             md.globalScaling = .05f + scalingFactor;
+            md.spatialHash = &spatialHash;
             agents[i]->update(md);
+            store.setTransform(i, agents[i]->getPosition(), agents[i]->getOrientationEuler());
         }
 
         if (isTransitioning){
-            // Calculate lerp value for LerpingAgent - as normalised time from start (zerp) to end (one)
-            // of the transition time.
-            float normalisedTime = (ofGetElapsedTimef() - startTransitionTime) / (endTransitionTime - startTransitionTime);
+            // Calculate lerp value as normalised time from start (zero) to end (one) of the
+            // transition time.
+            float normalisedTime = (FrameClock::getElapsedTimef() - startTransitionTime) / (endTransitionTime - startTransitionTime);
             
-            for (int i=0; i<lerpingAgents.size(); i++){
-                MoveData md;
-                md.normalisedValue1 = normalisedTime;
-                // End position could be constantly moving so keep updating the lerping agent here.
-                lerpingAgents[i].setEndPosition(agents[i]->getPosition());
-                lerpingAgents[i].update(md);
-            }
+            // End positions could be constantly moving so lerp towards the current ones.
+            const vector<ofVec3f> & endPositions = store.getPositions();
             
-            if (ofGetElapsedTimef() > endTransitionTime){
-                isTransitioning = false;
-
-                for (size_t i = 0; i < agents.size(); i++){
-                    agents[i]->setVisualisation(lerpingAgents[i].getVisualisation());
+            workerPool.parallelFor(transitionPositions.size(), ChunkSize, [&](size_t begin, size_t end){
+                for (size_t i=begin; i<end; i++){
+                    transitionPositions[i] = transitionStartPositions[i].getInterpolated(endPositions[i], normalisedTime);
                 }
+            });
+            
+            if (FrameClock::getElapsedTimef() > endTransitionTime){
+                isTransitioning = false;
             }
         }
         
         if (isAnimatingVisualisation){
-            float animationNormalisedTime = (ofGetElapsedTimef() - startVisualisationTime)
+            float animationNormalisedTime = (FrameClock::getElapsedTimef() - startVisualisationTime)
             / (endVisualisationTime - startVisualisationTime);
-            float animationPosition = ofMap(ofGetElapsedTimef(), startVisualisationTime, endVisualisationTime, this->fromAnimationPosition, this->toAnimationPosition);
+            float animationPosition = ofMap(FrameClock::getElapsedTimef(), startVisualisationTime, endVisualisationTime, this->fromAnimationPosition, this->toAnimationPosition);
             
-            for (auto i=agents.begin(); i!=agents.end(); i++){
-                (*i)->bringVisualisationHome(animationPosition);
-            }
+            // Visualisations are only modified on the render thread, see update().
+            homeness = animationPosition;
+            homenessVersion++;
             
-            if (ofGetElapsedTimef() > endVisualisationTime){
+            if (FrameClock::getElapsedTimef() > endVisualisationTime){
                 isAnimatingVisualisation = false;
             }
         }
     }
     
-    void transitionAgents(AgentSource &agentSource, float durationSeconds){
-        if (isTransitioning){
-            return;
-        }
+    void rebuildStore(){
+        store.clear();
+        store.resize(agents.size());
+        agentsOutsideStore.clear();
         
-        isTransitioning = true;
-
-        lerpingAgents.clear();
+        for (size_t i = 0; i < agents.size(); i++){
+            if (!agents[i]->addToStore(store, i)){
+                store.setTransform(i, agents[i]->getPosition(), agents[i]->getOrientationEuler());
+                agentsOutsideStore.push_back(i);
+            }
+        }
+    }
+    
+    void publishFrame(){
+        AgentsFrame & frame = frames.getBack();
+        frame.positions.resize(agents.size());
+        frame.orientationsEuler.resize(agents.size());
+        frame.visualisations.resize(agents.size());
         
         for (size_t i = 0; i < agents.size(); i++){
-            LerpingAgent lerpingAgent;
-            lerpingAgent.setStartPosition(agents[i]->getPosition());
-            unique_ptr<Agent> newAgent = move(agentSource.getAgent());
-            newAgent->setup();
-            lerpingAgent.setVisualisation(agents[i]->getVisualisation());
-            lerpingAgents.push_back(move(lerpingAgent));
-            agents[i] = move(newAgent);
+            if (isTransitioning){
+                // Visualisations travel unrotated during a transition.
+                frame.positions[i] = transitionPositions[i];
+                frame.orientationsEuler[i] = ofVec3f(0, 0, 0);
+            }else{
+                frame.positions[i] = store.getPosition(i);
+                frame.orientationsEuler[i] = store.getOrientationEuler(i);
+            }
+            frame.visualisations[i] = visualisations[i].get();
         }
         
-        startTransitionTime = ofGetElapsedTimef();
-        endTransitionTime = startTransitionTime + durationSeconds;
+        frame.homeness = homeness;
+        frame.homenessVersion = homenessVersion;
+        frames.publish();
     }
     
-    bool getIsTransitioning(){
-        return isTransitioning;
+    void applyFrameHomeness(const AgentsFrame & frame){
+        if (frame.homenessVersion == appliedHomenessVersion){
+            return;
+        }
+        
+        for (auto visualisation : frame.visualisations){
+            visualisation->bringItHome(frame.homeness);
+        }
+        
+        appliedHomenessVersion = frame.homenessVersion;
     }
     
-    void animateVisualisations(float durationSeconds, float fromAnimationPosition, float toAnimationPosition){
-        startVisualisationTime = ofGetElapsedTimef();
-        endVisualisationTime = startVisualisationTime + durationSeconds;
-        isAnimatingVisualisation = true;
-        this->fromAnimationPosition = fromAnimationPosition;
-        this->toAnimationPosition = toAnimationPosition;
+    // Gives the visualisations their agents' positions in the frame, with the emitters of
+    // agents no longer in it hidden.
+    void updateVisualisations(const AgentsFrame & frame){
+        if (particleSystem != nullptr){
+            particleSystem->hideEmitters();
+        }
+        
+        for (size_t i=0; i<frame.visualisations.size(); i++){
+            frame.visualisations[i]->update(frame.positions[i]);
+        }
     }
     
-    void draw(){
-        if (!isTransitioning){
-            for (int i=0; i<agents.size(); i++){
-                agents[i]->draw();
+    // Textured visualisations sharing a texture (e.g. sprites from an atlas) are drawn under
+    // one bind for as long as the texture doesn't change.
+    void drawFrame(const AgentsFrame & frame, bool isTextured, int increment){
+        const ofTexture * boundTexture = nullptr;
+        bool isInstancing = isTextured && spriteRenderer != nullptr && spriteRenderer->isReady();
+        
+        for (auto & batch : spriteBatches){
+            batch.second.clear();
+        }
+        
+        if (isCulling){
+            cull(frame, isTextured, increment);
+        }
+        
+        // Blending needs the textured agents drawn back to front.
+        const vector<uint32_t> * drawOrder = nullptr;
+        if (isTextured && isDepthSorting){
+            drawOrder = &depthSorter.sort(frame.positions, ofGetCurrentMatrix(OF_MATRIX_MODELVIEW), &drawPool);
+        }
+        
+        for (size_t k = 0; k < frame.visualisations.size(); k+=increment){
+            size_t i = drawOrder != nullptr ? (*drawOrder)[k] : k;
+            Visualisation * visualisation = frame.visualisations[i];
+            
+            if (isCulling && !isAgentVisible[i]){
+                continue;
             }
-        }else{
-            for (int i=0; i<lerpingAgents.size(); i++){
-                lerpingAgents[i].draw();
+            
+            if (!isTextured){
+                visualisation->drawUntextured(frame.positions[i], frame.orientationsEuler[i]);
+                continue;
+            }
+            
+            const ofTexture * texture = visualisation->getSharedTexture();
+            
+            if (isInstancing && texture != nullptr && addSpriteInstance(*visualisation, *texture, frame.positions[i], frame.orientationsEuler[i])){
+                continue;
+            }
+            
+            if (texture != boundTexture){
+                if (boundTexture != nullptr){
+                    boundTexture->unbind();
+                }
+                if (texture != nullptr){
+                    texture->bind();
+                }
+                boundTexture = texture;
+            }
+            
+            if (texture != nullptr){
+                visualisation->drawWithBoundTexture(frame.positions[i], frame.orientationsEuler[i]);
+            }else{
+                visualisation->draw(frame.positions[i], frame.orientationsEuler[i]);
+            }
+        }
+        
+        if (boundTexture != nullptr){
+            boundTexture->unbind();
+        }
+        
+        if (isInstancing){
+            for (auto & batch : spriteBatches){
+                spriteRenderer->draw(*batch.first, batch.second);
             }
         }
     }
     
-    void drawUntextured(int increment){
-        if (!isTransitioning){
-            for (int i=0; i<agents.size(); i+=increment){
-                agents[i]->drawUntextured();
-            }
-        }else{
-            for (int i=0; i<lerpingAgents.size(); i+=increment){
-                lerpingAgents[i].drawUntextured();
-            }
+    void cull(const AgentsFrame & frame, bool isTextured, int increment){
+        boundingRadii.resize(frame.visualisations.size());
+        
+        for (size_t i = 0; i < frame.visualisations.size(); i+=increment){
+            boundingRadii[i] = frame.visualisations[i]->getBoundingRadius();
+        }
+        
+        culler.setView(ofGetCurrentMatrix(OF_MATRIX_MODELVIEW), ofGetCurrentMatrix(OF_MATRIX_PROJECTION));
+        culler.cull(frame.positions, boundingRadii, increment, isTextured, isAgentVisible);
+
+        if (isTextured){
+            cullStats = culler.getStats();
         }
     }
     
-protected:
-    vector< unique_ptr<Agent> > agents;
-    vector< LerpingAgent > lerpingAgents;
-    bool isTransitioning;
-    bool isAnimatingVisualisation;
+    bool addSpriteInstance(const Visualisation & visualisation, const ofTexture & texture, ofVec3f position, ofVec3f orientationEuler){
+        SpriteInstance instance;
+        
+        if (!visualisation.getSpriteInstance(instance)){
+            return false;
+        }
+        
+        instance.position = position;
+        instance.orientation = SpriteInstance::getOrientation(orientationEuler);
+        
+        // Sprites almost always share one texture, so a linear search is quickest.
+        auto batch = find_if(spriteBatches.begin(), spriteBatches.end(), [&](const pair< const ofTexture *, vector<SpriteInstance> > & batch){
+            return batch.first == &texture;
+        });
+        
+        if (batch == spriteBatches.end()){
+            spriteBatches.emplace_back(&texture, vector<SpriteInstance>());
+            batch = spriteBatches.end() - 1;
+        }
+        
+        batch->second.push_back(instance);
+        return true;
+    }
+    
+    AgentArena agentArena;
+    vector<Agent *> agents;
+    vector<Agent *> newAgents;
+    vector< unique_ptr<Visualisation> > visualisations;
+    AgentSource * currentAgentSource = nullptr;
+    map< AgentSource *, vector<Agent *> > retiredAgents;
+    AgentStore store;
+    SpatialHash spatialHash;
+    float separationRadius = 20.f;
+    InstancedSpriteRenderer * spriteRenderer = nullptr;
+    bool isCulling = true;
+    AgentCuller culler;
+    AgentCuller::Stats cullStats;
+    vector<float> boundingRadii;
+    vector<uint8_t> isAgentVisible;
+    bool isDepthSorting = true;
+    DepthSorter depthSorter;
+    // Sprite instances by texture, kept between frames for their capacity.
+    vector< pair< const ofTexture *, vector<SpriteInstance> > > spriteBatches;
+    WorkerPool workerPool;
+    // For the render thread, as the simulation thread may be using workerPool meanwhile.
+    WorkerPool drawPool;
+    // From the visualisation source, if its visualisations emit particles.
+    shared_ptr<ParticleSystem> particleSystem;
+    vector<size_t> agentsOutsideStore;
+    NoiseField noiseField1, noiseField2;
+    vector<ofVec3f> transitionStartPositions, transitionPositions;
+    atomic<bool> isTransitioning {false};
+    bool isAnimatingVisualisation = false;
     float fromAnimationPosition, toAnimationPosition;
     float startTransitionTime, endTransitionTime;
     float startVisualisationTime, endVisualisationTime;
+    
+    // Threaded simulation.
+    thread simulationThread;
+    mutex simulationMutex;
+    atomic<bool> isThreaded {false};
+    atomic<bool> isSimulating {false};
+    atomic<float> scalingFactor {0.f};
+    TripleBuffer<AgentsFrame> frames;
+    float homeness = 0.f;
+    unsigned int homenessVersion = 0;
+    unsigned int appliedHomenessVersion = 0;
 };
\ No newline at end of file
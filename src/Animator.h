@@ -1,5 +1,7 @@
 #pragma once
 
+#include "FrameClock.h"
+
 class Animator {
 public:
     enum class Direction { In, Out };
@@ -13,7 +15,7 @@ public:
     }
     
     void animate(Direction direction){
-        startTime = ofGetElapsedTimef();
+        startTime = FrameClock::getElapsedTimef();
         endTime = startTime + duration;
         this->direction = direction;
         isOut = false;
@@ -21,17 +23,16 @@ public:
     
     float getValue(){
         if (direction == Direction::In){
-            return ofMap(ofGetElapsedTimef(), startTime, endTime, startValue, endValue, true);
+            return ofMap(FrameClock::getElapsedTimef(), startTime, endTime, startValue, endValue, true);
         } else {
-            if (ofGetElapsedTimef() > endTime){
-                isOut = true;
-            }
-            return ofMap(ofGetElapsedTimef(), startTime, endTime, endValue, startValue, true);
+            return ofMap(FrameClock::getElapsedTimef(), startTime, endTime, endValue, startValue, true);
         }
     }
     
+    // From the time alone, so that it doesn't depend on whether getValue() was called,
+    // e.g. while an export fast-forwards without drawing.
     bool isAnimatedOut(){
-        return isOut;
+        return isOut || (direction == Direction::Out && FrameClock::getElapsedTimef() > endTime);
     }
     
 protected:
@@ -1,6 +1,7 @@
 #include "Blur.h"
 
 #include "ofGraphics.h"
+#include "FrameClock.h"
 
 Blur::Blur(){
     resize(0.f, 0.f);
@@ -14,6 +15,12 @@ void Blur::setup(float width, float height){
         blurShader.load("", "shaders/gaussianBlur.frag");
     }
     
+    // The pyramid's shaders only come in GL3 versions.
+    if(ofIsGLProgrammableRenderer()){
+        downsampleShader.load("shaders_gl3/passThrough.vert", "shaders_gl3/dualKawaseDownsample.frag");
+        upsampleShader.load("shaders_gl3/passThrough.vert", "shaders_gl3/dualKawaseUpsample.frag");
+    }
+    
     resize(width, height);
     
     distribution = 1.f;
@@ -23,6 +30,10 @@ void Blur::setup(float width, float height){
     maxDistribution = 5.f;
     minKernelSize = 1.f;
     maxKernelSize = 15.f;
+    
+    updateWeights();
+    numPyramidLevels = 1;
+    pyramidOffset = 1.f;
 }
 
 void Blur::setBlurStrength(float normalisedStrength){
@@ -33,6 +44,23 @@ void Blur::setBlurStrength(float normalisedStrength){
     
     distribution = ofMap(normalisedStrength, 0, 1, minDistribution, maxDistribution);
     kernelSize = ofMap(normalisedStrength, 0, 1, minKernelSize, maxKernelSize);
+    updateWeights();
+    
+    // The pyramid's radius about doubles with each level, so levels are added along a log
+    // scale of the strength, and the offset covers the range in between.
+    float depth = ofMap(normalisedStrength, 0, 1, 0, MaxPyramidLevels);
+    numPyramidLevels = max(1, int(ceil(depth)));
+    pyramidOffset = ofMap(depth - (numPyramidLevels - 1), 0, 1, .5f, 1.5f, true);
+}
+
+void Blur::setMode(Mode mode){
+    if (mode == Mode::Pyramid && !(downsampleShader.isLoaded() && upsampleShader.isLoaded())){
+        ofLogWarning() << "Blur::setMode(): pyramid shaders aren't loaded, keeping the Gaussian blur" << endl;
+        return;
+    }
+    
+    this->mode = mode;
+    allocatePyramid();
 }
 
 void Blur::begin(){
@@ -54,25 +82,41 @@ void Blur::end(){
     
     buffer1.end();
     
+    if (isUsingPyramid()){
+        // Down the pyramid from buffer1, then back up into buffer2.
+        int numLevels = min<int>(numPyramidLevels, pyramid.size());
+        drawPyramidPass(downsampleShader, buffer1, pyramid[0]);
+        for (int level=1; level<numLevels; level++){
+            drawPyramidPass(downsampleShader, pyramid[level - 1], pyramid[level]);
+        }
+        for (int level=numLevels-1; level>0; level--){
+            drawPyramidPass(upsampleShader, pyramid[level], pyramid[level - 1]);
+        }
+        drawPyramidPass(upsampleShader, pyramid[0], buffer2);
+        return;
+    }
+    
     // buffer2 will store the results of the vertical pass of the blur shader.
     buffer2.begin();
     ofClear(0);
     // Draw buffer1 one through the blur shader with a vertical pass.
     blurShader.begin();
-    blurShader.setUniform2f("direction", 0.f, 1.f);
-    blurShader.setUniform1f("kernelSize", kernelSize);
-    blurShader.setUniform1f("distribution", distribution);
+    setGaussianUniforms(0.f, 1.f);
     buffer1.draw(0.f, 0.f);
     blurShader.end();
     buffer2.end();
 }
 
 void Blur::draw(float x, float y){
+    // buffer2 already holds the pyramid's result.
+    if (isUsingPyramid()){
+        buffer2.draw(x, y);
+        return;
+    }
+    
     // Draw buffer2 through the blur shader with a horizontal pass.
     blurShader.begin();
-    blurShader.setUniform2f("direction", 1.f, 0.f);
-    blurShader.setUniform1f("kernelSize", kernelSize);
-    blurShader.setUniform1f("distribution", distribution);
+    setGaussianUniforms(1.f, 0.f);
     buffer2.draw(x, y);
     blurShader.end();
 }
@@ -88,12 +132,154 @@ void Blur::resize(float width, float height){
     
     buffer1.allocate(width, height);
     buffer2.allocate(width, height);
+    pyramid.clear();
+    allocatePyramid();
 }
 
 ofTexture & Blur::getTexture(){
     return buffer1.getTexture();
 }
 
+void Blur::addPasses(RenderGraph & graph, RenderGraph::Target source, RenderGraph::Target destination){
+    if (!blurShader.isLoaded()){
+        ofLogWarning() << "Blur::addPasses(): shader isn't loaded. Blur::setup() needs to be called before Blur::addPasses()" << endl;
+        return;
+    }
+    
+    int sourceWidth = graph.getWidth(source);
+    int sourceHeight = graph.getHeight(source);
+    int numLevels = mode == Mode::Pyramid ? getNumPyramidLevels(sourceWidth, sourceHeight) : 0;
+    
+    if (numLevels == 0){
+        RenderGraph::Target vertical = graph.createTarget("blurVertical", sourceWidth, sourceHeight);
+        graph.addShaderPass("blurVertical", source, vertical, blurShader, [this](ofShader &){
+            setGaussianUniforms(0.f, 1.f);
+        });
+        graph.addShaderPass("blurHorizontal", vertical, destination, blurShader, [this](ofShader &){
+            setGaussianUniforms(1.f, 0.f);
+        });
+        return;
+    }
+    
+    auto setOffset = [this](ofShader & shader){
+        shader.setUniform1f("offset", pyramidOffset);
+    };
+    
+    vector<RenderGraph::Target> levels;
+    for (int level=0; level<numLevels; level++){
+        levels.push_back(graph.createTarget("blurPyramid" + ofToString(level), sourceWidth >> (level + 1), sourceHeight >> (level + 1)));
+    }
+    
+    // Each level is written on the way down and again on the way up, into a new target so
+    // that no pass reads what it writes.
+    graph.addShaderPass("blurDown0", source, levels[0], downsampleShader, setOffset);
+    for (int level=1; level<numLevels; level++){
+        graph.addShaderPass("blurDown" + ofToString(level), levels[level - 1], levels[level], downsampleShader, setOffset);
+    }
+    
+    RenderGraph::Target upSource = levels[numLevels - 1];
+    for (int level=numLevels-2; level>=0; level--){
+        RenderGraph::Target up = graph.createTarget("blurUp" + ofToString(level), graph.getWidth(levels[level]), graph.getHeight(levels[level]));
+        graph.addShaderPass("blurUp" + ofToString(level), upSource, up, upsampleShader, setOffset);
+        upSource = up;
+    }
+    graph.addShaderPass("blurUpOut", upSource, destination, upsampleShader, setOffset);
+}
+
+int Blur::getNumPyramidLevels(int width, int height){
+    if (!(downsampleShader.isLoaded() && upsampleShader.isLoaded())){
+        return 0;
+    }
+    
+    // As in allocatePyramid(), only sizes that halve exactly.
+    int numLevels = 0;
+    
+    while (numLevels < numPyramidLevels && width % 2 == 0 && height % 2 == 0){
+        width /= 2;
+        height /= 2;
+        numLevels++;
+    }
+    
+    return numLevels;
+}
+
+void Blur::updateWeights(){
+    // Taps 0 to lastTap a side of the centre, weighted by a Gaussian. Its constant factor
+    // cancels out in the normalisation.
+    int lastTap = ofClamp(ceil(kernelSize) - 1, 0, 2*(MaxTaps - 1));
+    float tapWeights[MaxTaps * 2];
+    float weightSum = 0.f;
+    
+    for (int i=0; i<=lastTap; i++){
+        tapWeights[i] = exp(-(i*i) / (2.f*distribution*distribution));
+        weightSum += i == 0 ? tapWeights[i] : 2.f*tapWeights[i];
+    }
+    
+    weights[0] = tapWeights[0] / weightSum;
+    offsets[0] = 0.f;
+    numTaps = 1;
+    
+    // A linearly filtered fetch between taps i and i+1, at the point that splits their
+    // weights, gets both of them. A last tap without a partner is fetched on its own.
+    for (int i=1; i<=lastTap; i+=2){
+        float weight1 = tapWeights[i];
+        float weight2 = i < lastTap ? tapWeights[i + 1] : 0.f;
+        
+        weights[numTaps] = (weight1 + weight2) / weightSum;
+        offsets[numTaps] = (i*weight1 + (i + 1)*weight2) / (weight1 + weight2);
+        numTaps++;
+    }
+    
+    for (int i=numTaps; i<MaxTaps; i++){
+        weights[i] = 0.f;
+        offsets[i] = 0.f;
+    }
+}
+
+void Blur::allocatePyramid(){
+    if (mode != Mode::Pyramid || !isSetup() || !pyramid.empty()){
+        return;
+    }
+    
+    // Only sizes that halve exactly, as the shaders' offsets assume a scale of two between
+    // levels. Odd sizes end the pyramid early and change the image's brightness otherwise.
+    int levelWidth = buffer1.getWidth();
+    int levelHeight = buffer1.getHeight();
+    pyramid.reserve(MaxPyramidLevels);
+    
+    while (pyramid.size() < MaxPyramidLevels && levelWidth % 2 == 0 && levelHeight % 2 == 0){
+        levelWidth /= 2;
+        levelHeight /= 2;
+        pyramid.emplace_back();
+        pyramid.back().allocate(levelWidth, levelHeight);
+    }
+    
+    if (pyramid.empty()){
+        ofLogWarning() << "Blur::allocatePyramid(): " << buffer1.getWidth() << "x" << buffer1.getHeight() << " can't be halved, using the Gaussian blur" << endl;
+    }
+}
+
+bool Blur::isUsingPyramid(){
+    return mode == Mode::Pyramid && !pyramid.empty();
+}
+
+void Blur::setGaussianUniforms(float directionX, float directionY){
+    blurShader.setUniform2f("direction", directionX, directionY);
+    blurShader.setUniform1fv("weights", weights, MaxTaps);
+    blurShader.setUniform1fv("offsets", offsets, MaxTaps);
+    blurShader.setUniform1i("numTaps", numTaps);
+}
+
+void Blur::drawPyramidPass(ofShader & shader, ofFbo & source, ofFbo & destination){
+    destination.begin();
+    ofClear(0);
+    shader.begin();
+    shader.setUniform1f("offset", pyramidOffset);
+    source.draw(0.f, 0.f, destination.getWidth(), destination.getHeight());
+    shader.end();
+    destination.end();
+}
+
 void RandomBlur::setup(float width, float height){
     Blur::setup(width, height);
     
@@ -103,8 +289,8 @@ void RandomBlur::setup(float width, float height){
     blurOffMax = 4.f;
     blurOnMin = 2.f;
     blurOffMax = 4.f;
-    lastBlurEndTime = ofGetElapsedTimef();
-    thisBlurStartTime = ofGetElapsedTimef();
+    lastBlurEndTime = FrameClock::getElapsedTimef();
+    thisBlurStartTime = FrameClock::getElapsedTimef();
 }
 
 void RandomBlur::begin(){
@@ -114,14 +300,14 @@ void RandomBlur::begin(){
     // animate blur in for a while, and then out
     
     if (!isBlurring){
-        if (ofGetElapsedTimef() - lastBlurEndTime > blurOffMin){
+        if (FrameClock::getElapsedTimef() - lastBlurEndTime > blurOffMin){
             isBlurring = true;
-            thisBlurStartTime = ofGetElapsedTimef();
+            thisBlurStartTime = FrameClock::getElapsedTimef();
         }
     } else {
-        if (ofGetElapsedTimef() - thisBlurStartTime > blurOnMin){
+        if (FrameClock::getElapsedTimef() - thisBlurStartTime > blurOnMin){
             isBlurring = false;
-            lastBlurEndTime = ofGetElapsedTimef();
+            lastBlurEndTime = FrameClock::getElapsedTimef();
         }
     }
     
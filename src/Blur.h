@@ -2,27 +2,68 @@
 
 #include "ofShader.h"
 #include "ofFbo.h"
+#include "RenderGraph.h"
 
+// Blurs whatever is drawn between begin() and end(). Two modes:
+// Gaussian is a separable Gaussian blur. Its weights are worked out on the CPU whenever the
+// strength changes, and neighbouring taps are merged into one linearly filtered fetch
+// between them, so a kernel of n taps a side takes about n / 2 fetches a side.
+// Pyramid is a dual Kawase blur: the image is downsampled by half a few times and then
+// upsampled back, with a few fetches per pixel on the way. Each level doubles the radius
+// at a quarter of the previous level's cost, so wide radii cost about the same as narrow
+// ones.
 class Blur {
 public:
+    enum class Mode { Gaussian, Pyramid };
+    
     Blur();
     virtual void setup(float width = 0.f, float height = 0.f);
     virtual void setBlurStrength(float normalisedStrength);
+    // After setup(), which loads the pyramid's shaders.
+    virtual void setMode(Mode mode);
     virtual void begin();
     virtual void end();
     virtual void draw(float x, float y);
     virtual bool isSetup();
     virtual void resize(float width, float height);
     virtual ofTexture & getTexture();
+    // Blurs source into destination as passes of graph, with intermediate targets from the
+    // graph rather than the blur's own buffers, which then needn't be allocated: call
+    // setup() without a size. The passes use the strength and mode at the time.
+    virtual void addPasses(RenderGraph & graph, RenderGraph::Target source, RenderGraph::Target destination);
     
 protected:
+    // Enough for maxKernelSize: the centre tap, then pairs of taps a side.
+    const static int MaxTaps = 8;
+    const static int MaxPyramidLevels = 5;
+    
+    void updateWeights();
+    void allocatePyramid();
+    bool isUsingPyramid();
+    void setGaussianUniforms(float directionX, float directionY);
+    int getNumPyramidLevels(int width, int height);
+    void drawPyramidPass(ofShader & shader, ofFbo & source, ofFbo & destination);
+    
     float left, top, width, height;
     float distribution;
     float kernelSize;
+    // Normalised weights and offsets in texels of the merged taps, the centre tap first.
+    float weights[MaxTaps];
+    float offsets[MaxTaps];
+    int numTaps;
+    
+    Mode mode = Mode::Gaussian;
+    int numPyramidLevels;
+    // How far apart the pyramid's fetches are, in texels of the level they read from.
+    float pyramidOffset;
     
     float minDistribution, maxDistribution, minKernelSize, maxKernelSize;
     ofShader blurShader;
+    ofShader downsampleShader, upsampleShader;
     ofFbo buffer1, buffer2;
+    // Half the size of buffer1, then a quarter and so on, only in Pyramid mode. May have
+    // fewer than MaxPyramidLevels levels, see allocatePyramid().
+    vector<ofFbo> pyramid;
 };
 
 class RandomBlur : public Blur {
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "ofMain.h"
+
+// A closed path through the outlines of a shape (e.g. a letter), resampled at equal
+// arc-length intervals so that the point at any distance along it is a table lookup and
+// one interpolation. The outlines are joined in order, each one closed, with a straight
+// segment from the end of one to the start of the next and from the last back to the first.
+class ContourPath {
+public:
+    void setup(const vector<ofPolyline> &outlines, float sampleSpacing = 1.f){
+        samples.clear();
+        length = 0.f;
+
+        vector<ofVec3f> points;
+
+        for (auto &outline : outlines){
+            auto &vertices = outline.getVertices();
+
+            if (vertices.size() == 0){
+                continue;
+            }
+
+            points.insert(points.end(), vertices.begin(), vertices.end());
+            points.push_back(vertices.front());
+        }
+
+        if (points.size() < 2){
+            return;
+        }
+
+        points.push_back(points.front());
+
+        // Cumulative arc length at each point.
+        vector<float> distances(points.size(), 0.f);
+        for (size_t i=1; i<points.size(); i++){
+            distances[i] = distances[i-1] + points[i-1].distance(points[i]);
+        }
+
+        length = distances.back();
+
+        if (length <= 0.f){
+            length = 0.f;
+            return;
+        }
+
+        size_t numSamples = ofClamp(ceil(length / sampleSpacing), 1, MaxSamples);
+        spacing = length / numSamples;
+        inverseSpacing = 1.f / spacing;
+        samples.resize(numSamples + 1);
+
+        size_t segment = 0;
+        for (size_t k=0; k<numSamples; k++){
+            float distance = k * spacing;
+
+            while (segment + 2 < distances.size() && distances[segment + 1] < distance){
+                segment++;
+            }
+
+            float segmentLength = distances[segment + 1] - distances[segment];
+            float t = segmentLength > 0.f ? (distance - distances[segment]) / segmentLength : 0.f;
+            samples[k] = points[segment].getInterpolated(points[segment + 1], t);
+        }
+
+        // Repeat the first sample so that lookups near the end can interpolate towards it.
+        samples[numSamples] = samples[0];
+    }
+
+    void translate(ofVec3f offset){
+        for (auto &sample : samples){
+            sample += offset;
+        }
+    }
+
+    bool isEmpty() const{
+        return samples.empty();
+    }
+
+    float getLength() const{
+        return length;
+    }
+
+    // Brings any distance along the path into [0, length).
+    float wrap(float pathPosition) const{
+        pathPosition = fmod(pathPosition, length);
+        return pathPosition < 0.f ? pathPosition + length : pathPosition;
+    }
+
+    // pathPosition must be in [0, length], see wrap().
+    ofVec3f getPointAt(float pathPosition) const{
+        float u = pathPosition * inverseSpacing;
+        size_t k = min<size_t>(u, samples.size() - 2);
+        return samples[k].getInterpolated(samples[k + 1], u - k);
+    }
+
+protected:
+    const static size_t MaxSamples = 1 << 14;
+
+    vector<ofVec3f> samples;
+    float length = 0.f;
+    float spacing = 1.f;
+    float inverseSpacing = 1.f;
+};
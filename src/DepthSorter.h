@@ -0,0 +1,255 @@
+#pragma once
+
+#include "ofMain.h"
+#include "Simd.h"
+#include "WorkerPool.h"
+
+// Keeps agents in back to front order for blending, making use of how little the order
+// changes from one frame to the next. Depths are quantized to 32768 steps of their range,
+// finer than sprites can be told apart in depth, and agents in the same step are in index
+// order, so the order only depends on the current positions and view. Each sort looks the
+// new steps up in the last order and counts the neighbours now out of order. Few of them,
+// as when the camera and agents are still, are fixed with an insertion sort, which is
+// linear when only neighbours swap. Otherwise, which is usual for moving agents, the
+// agents are bucketed by step in index order.
+// Pass a WorkerPool to spread the passes over threads; the order doesn't depend on the
+// number of threads.
+class DepthSorter {
+public:
+    // Indices into positions from farthest to nearest along the view direction of
+    // modelView (openFrameworks' row vector convention), i.e. in the order to draw them.
+    const vector<uint32_t> & sort(const vector<ofVec3f> & positions, const ofMatrix4x4 & modelView, WorkerPool * pool = nullptr){
+        size_t count = positions.size();
+
+        if (order.size() != count){
+            order.resize(count);
+            for (size_t k=0; k<count; k++){
+                order[k] = k;
+            }
+        }
+
+        if (count == 0){
+            return order;
+        }
+
+        updateDepths(positions, modelView, pool);
+
+        // Each entry out of order costs at least one move, so with many of them the
+        // insertion sort isn't worth trying.
+        size_t numDescents = updateOrderSteps(pool);
+        if (numDescents == 0 || (numDescents <= count / MinEntriesPerDescent && insertionSort(count / MinEntriesPerMove))){
+            isLastSortIncremental = true;
+        }else{
+            bucketSort(pool);
+            isLastSortIncremental = false;
+        }
+
+        return order;
+    }
+
+    // Whether the last sort only had to fix up the order before it.
+    bool getIsLastSortIncremental() const{
+        return isLastSortIncremental;
+    }
+
+protected:
+    // Past about a move per few entries, the insertion sort costs more than bucketing.
+    const size_t MinEntriesPerMove = 4;
+    const size_t MinEntriesPerDescent = 64;
+    const size_t ChunkSize = 16384;
+    const size_t NumSteps = 1 << 15;
+
+    // Depth in view space, where the eye looks down -z, so farther is smaller, worked out
+    // in agent order, and its range.
+    void updateDepths(const vector<ofVec3f> & positions, const ofMatrix4x4 & modelView, WorkerPool * pool){
+        size_t count = positions.size();
+        float mx = modelView(0, 2), my = modelView(1, 2), mz = modelView(2, 2), mw = modelView(3, 2);
+
+        depths.resize(count);
+        size_t numChunks = (count + ChunkSize - 1) / ChunkSize;
+        chunkMinDepths.resize(numChunks);
+        chunkMaxDepths.resize(numChunks);
+
+        const ofVec3f * agentPositions = positions.data();
+        float * agentDepths = depths.data();
+
+        forEachPart(count, ChunkSize, pool, [&](size_t begin, size_t end){
+            for (size_t i=begin; i<end; i++){
+                agentDepths[i] = mx * agentPositions[i].x + my * agentPositions[i].y + mz * agentPositions[i].z + mw;
+            }
+
+            Float8 minDepths = Float8::broadcast(agentDepths[begin]);
+            Float8 maxDepths = minDepths;
+            size_t i = begin;
+
+            for (; i + Float8::Width <= end; i+=Float8::Width){
+                Float8 block = Float8::load(agentDepths + i);
+                minDepths = Float8::min(minDepths, block);
+                maxDepths = Float8::max(maxDepths, block);
+            }
+
+            float lanes[2][Float8::Width];
+            minDepths.store(lanes[0]);
+            maxDepths.store(lanes[1]);
+            float minDepth = *min_element(lanes[0], lanes[0] + Float8::Width);
+            float maxDepth = *max_element(lanes[1], lanes[1] + Float8::Width);
+
+            for (; i<end; i++){
+                minDepth = min(minDepth, agentDepths[i]);
+                maxDepth = max(maxDepth, agentDepths[i]);
+            }
+
+            chunkMinDepths[begin / ChunkSize] = minDepth;
+            chunkMaxDepths[begin / ChunkSize] = maxDepth;
+        });
+    }
+
+    // Quantizes the depths to steps, looks them up in the last order and counts the
+    // descents, i.e. neighbours out of order by step and index.
+    size_t updateOrderSteps(WorkerPool * pool){
+        size_t count = order.size();
+
+        float minDepth = *min_element(chunkMinDepths.begin(), chunkMinDepths.end());
+        float maxDepth = *max_element(chunkMaxDepths.begin(), chunkMaxDepths.end());
+        float scale = maxDepth > minDepth ? (NumSteps - 1) / (maxDepth - minDepth) : 0.f;
+        float maxStep = NumSteps - 1;
+
+        agentSteps.resize(count);
+        orderSteps.resize(count);
+        chunkCounts.resize((count + ChunkSize - 1) / ChunkSize);
+
+        const float * agentDepths = depths.data();
+        uint16_t * stepsByAgent = agentSteps.data();
+
+        forEachPart(count, ChunkSize, pool, [&](size_t begin, size_t end){
+            for (size_t i=begin; i<end; i++){
+                stepsByAgent[i] = uint16_t(min((agentDepths[i] - minDepth) * scale, maxStep));
+            }
+        });
+
+        const uint32_t * indices = order.data();
+        uint16_t * steps = orderSteps.data();
+
+        forEachPart(count, ChunkSize, pool, [&](size_t begin, size_t end){
+            for (size_t k=begin; k<end; k++){
+                steps[k] = stepsByAgent[indices[k]];
+            }
+
+            size_t numDescents = 0;
+            for (size_t k=begin + 1; k<end; k++){
+                numDescents += isAfter(steps[k - 1], indices[k - 1], steps[k], indices[k]);
+            }
+
+            chunkCounts[begin / ChunkSize] = numDescents;
+        });
+
+        size_t numDescents = 0;
+        for (size_t c=0; c<chunkCounts.size(); c++){
+            size_t k = c * ChunkSize;
+            numDescents += chunkCounts[c] + (c > 0 && isAfter(steps[k - 1], indices[k - 1], steps[k], indices[k]));
+        }
+
+        return numDescents;
+    }
+
+    // Whether the agent at step with index is drawn after the one at otherStep with
+    // otherIndex. Without branches, so that counting descents vectorises.
+    static bool isAfter(uint16_t step, uint32_t index, uint16_t otherStep, uint32_t otherIndex){
+        return (step > otherStep) | ((step == otherStep) & (index > otherIndex));
+    }
+
+    // Returns false if it would take more than maxMoves, leaving the order sorted up to
+    // where it stopped and as it was after that.
+    bool insertionSort(size_t maxMoves){
+        size_t numMoves = 0;
+
+        for (size_t k=1; k<order.size(); k++){
+            uint16_t step = orderSteps[k];
+            uint32_t index = order[k];
+            size_t j = k;
+
+            while (j > 0 && isAfter(orderSteps[j - 1], order[j - 1], step, index)){
+                orderSteps[j] = orderSteps[j - 1];
+                order[j] = order[j - 1];
+                j--;
+            }
+
+            orderSteps[j] = step;
+            order[j] = index;
+            numMoves += k - j;
+
+            if (numMoves > maxMoves){
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Counts the agents per step, works out where each step's bucket starts and moves the
+    // agents there. With a pool, each thread counts and moves a part of the agents; parts
+    // fill each bucket in turn, which keeps the agents in it in index order.
+    void bucketSort(WorkerPool * pool){
+        size_t count = order.size();
+        size_t numParts = pool != nullptr ? pool->getNumThreads() : 1;
+        size_t partSize = (count + numParts - 1) / numParts;
+        numParts = (count + partSize - 1) / partSize;
+
+        bucketStarts.resize(numParts * NumSteps);
+
+        forEachPart(count, partSize, pool, [&](size_t begin, size_t end){
+            uint32_t * counts = &bucketStarts[begin / partSize * NumSteps];
+            const uint16_t * steps = agentSteps.data();
+            fill(counts, counts + NumSteps, 0);
+
+            for (size_t i=begin; i<end; i++){
+                counts[steps[i]]++;
+            }
+        });
+
+        uint32_t start = 0;
+        for (size_t step=0; step<NumSteps; step++){
+            for (size_t part=0; part<numParts; part++){
+                uint32_t & bucketStart = bucketStarts[part * NumSteps + step];
+                uint32_t numEntries = bucketStart;
+                bucketStart = start;
+                start += numEntries;
+            }
+        }
+
+        sortedOrder.resize(count);
+
+        forEachPart(count, partSize, pool, [&](size_t begin, size_t end){
+            uint32_t * starts = &bucketStarts[begin / partSize * NumSteps];
+            const uint16_t * steps = agentSteps.data();
+            uint32_t * sortedIndices = sortedOrder.data();
+
+            for (size_t i=begin; i<end; i++){
+                sortedIndices[starts[steps[i]]++] = i;
+            }
+        });
+
+        order.swap(sortedOrder);
+    }
+
+    // Calls function(begin, end) for consecutive parts of [0, count).
+    template<class Function>
+    void forEachPart(size_t count, size_t partSize, WorkerPool * pool, Function function){
+        if (pool != nullptr){
+            pool->parallelFor(count, partSize, function);
+        }else{
+            for (size_t begin=0; begin<count; begin+=partSize){
+                function(begin, min(begin + partSize, count));
+            }
+        }
+    }
+
+    vector<float> depths;
+    vector<float> chunkMinDepths, chunkMaxDepths;
+    vector<size_t> chunkCounts;
+    // Depth steps by agent, and the same in the last order.
+    vector<uint16_t> agentSteps, orderSteps;
+    vector<uint32_t> bucketStarts;
+    vector<uint32_t> order, sortedOrder;
+    bool isLastSortIncremental = true;
+};
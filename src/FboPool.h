@@ -0,0 +1,77 @@
+#pragma once
+
+#include "ofMain.h"
+
+// Hands out framebuffers by size and format, for targets that only live for part of a
+// frame. A released framebuffer goes back to the pool for the next target of the same
+// kind, so effects that run one after the other share their memory rather than each
+// allocating their own. Nothing is ever freed; the pool only grows to the most targets
+// of a kind alive at once.
+class FboPool {
+public:
+    ofFbo * acquire(int width, int height, int internalFormat = GL_RGBA){
+        for (auto & entry : entries){
+            if (!entry.isInUse && entry.width == width && entry.height == height && entry.internalFormat == internalFormat){
+                entry.isInUse = true;
+                return entry.fbo.get();
+            }
+        }
+
+        Entry entry;
+        entry.width = width;
+        entry.height = height;
+        entry.internalFormat = internalFormat;
+        entry.fbo.reset(new ofFbo());
+        entry.fbo->allocate(width, height, internalFormat);
+        entry.isInUse = true;
+        entries.push_back(move(entry));
+
+        return entries.back().fbo.get();
+    }
+
+    void release(ofFbo * fbo){
+        for (auto & entry : entries){
+            if (entry.fbo.get() == fbo){
+                entry.isInUse = false;
+                return;
+            }
+        }
+
+        ofLogWarning() << "FboPool::release() The framebuffer isn't from this pool" << endl;
+    }
+
+    size_t getNumFbos() const{
+        return entries.size();
+    }
+
+    // Roughly, from the formats' sizes, for keeping an eye on video memory.
+    size_t getNumBytes() const{
+        size_t numBytes = 0;
+
+        for (auto & entry : entries){
+            numBytes += size_t(entry.width) * entry.height * getBytesPerPixel(entry.internalFormat);
+        }
+
+        return numBytes;
+    }
+
+protected:
+    struct Entry {
+        int width = 0;
+        int height = 0;
+        int internalFormat = GL_RGBA;
+        unique_ptr<ofFbo> fbo;
+        bool isInUse = false;
+    };
+
+    static size_t getBytesPerPixel(int internalFormat){
+        switch (internalFormat){
+            case GL_RGBA32F: return 16;
+            case GL_RGBA16F: return 8;
+            case GL_R32F: return 4;
+            default: return 4;
+        }
+    }
+
+    vector<Entry> entries;
+};
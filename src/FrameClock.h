@@ -0,0 +1,48 @@
+#pragma once
+
+#include "ofMain.h"
+#include <atomic>
+
+// The time that animations, transitions and the simulation run on. It's ofGetElapsedTimef()
+// until setFixedTime() is called; from then on it only moves when it is told to, e.g. by an
+// offline render stepping it a frame at a time, so that every run produces the same frames
+// however long each one takes to draw. The clock is shared by the whole app and may be read
+// from any thread.
+class FrameClock {
+public:
+    static float getElapsedTimef(){
+        State & state = getState();
+        return state.isFixed ? float(state.fixedTime.load()) : ofGetElapsedTimef();
+    }
+
+    static bool isFixed(){
+        return getState().isFixed;
+    }
+
+    static void setFixedTime(double seconds){
+        State & state = getState();
+        state.fixedTime = seconds;
+        state.isFixed = true;
+    }
+
+    static void advance(double seconds){
+        State & state = getState();
+        state.fixedTime = state.fixedTime.load() + seconds;
+    }
+
+    // Back to ofGetElapsedTimef().
+    static void clearFixedTime(){
+        getState().isFixed = false;
+    }
+
+protected:
+    struct State {
+        atomic<bool> isFixed {false};
+        atomic<double> fixedTime {0.};
+    };
+
+    static State & getState(){
+        static State state;
+        return state;
+    }
+};
@@ -0,0 +1,239 @@
+#pragma once
+
+#include "ofMain.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+
+// Renders frames offscreen at any size and writes them out as an image sequence, without
+// the render thread waiting on the GPU or the disk while it can avoid it.
+// Whatever is drawn between begin() and end() goes to a framebuffer of the export size.
+// end() starts an asynchronous read of it into the next of a ring of pixel buffers and
+// collects the oldest read in the ring, which by then has had a few frames to finish, so
+// the readback overlaps the next frames' drawing. Collected frames are queued for a pool
+// of encoder threads, which write frame_000000.png or .raw files; raw frames are
+// width * height * 3 bytes of 8 bit RGB, top row first. The queue is bounded, so when
+// encoding can't keep up, end() waits for it rather than filling memory.
+class FrameExporter {
+public:
+    enum class Format { Png, Raw };
+
+    struct Settings {
+        // Relative to the data folder unless absolute.
+        string directory;
+        int width = 3840;
+        int height = 2160;
+        Format format = Format::Png;
+        size_t numEncoderThreads = max<size_t>(thread::hardware_concurrency(), 1);
+        size_t numReadbackBuffers = 3;
+    };
+
+    ~FrameExporter(){
+        finish();
+    }
+
+    bool setup(const Settings & settings){
+        finish();
+
+        this->settings = settings;
+        directory = ofToDataPath(settings.directory, true);
+
+        if (!ofDirectory::doesDirectoryExist(directory, false) && !ofDirectory::createDirectory(directory, false, true)){
+            ofLogError() << "FrameExporter::setup() Couldn't create " << directory << endl;
+            return false;
+        }
+
+        fbo.allocate(settings.width, settings.height, GL_RGBA);
+        numBytesPerFrame = size_t(settings.width) * settings.height * 3;
+
+        readbacks.clear();
+        readbacks.resize(max<size_t>(settings.numReadbackBuffers, 2));
+        for (auto & readback : readbacks){
+            readback.buffer.allocate(numBytesPerFrame, GL_STREAM_READ);
+        }
+        nextReadback = 0;
+
+        numFramesWritten = 0;
+        isStopping = false;
+        for (size_t i=0; i<max<size_t>(settings.numEncoderThreads, 1); i++){
+            encoders.emplace_back(&FrameExporter::encodeLoop, this);
+        }
+
+        return true;
+    }
+
+    void begin(){
+        fbo.begin();
+    }
+
+    // frameNum names the file.
+    void end(uint64_t frameNum){
+        Readback & readback = readbacks[nextReadback];
+        if (readback.isPending){
+            collect(readback);
+        }
+
+        // Read while the framebuffer is still bound. OF draws into framebuffers upside down,
+        // so rows come out top first.
+        readback.buffer.bind(GL_PIXEL_PACK_BUFFER);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, settings.width, settings.height, GL_RGB, GL_UNSIGNED_BYTE, 0);
+        readback.buffer.unbind(GL_PIXEL_PACK_BUFFER);
+        readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        readback.frameNum = frameNum;
+        readback.isPending = true;
+
+        fbo.end();
+
+        // The ring is used in order, so the slot after this one holds the oldest read.
+        nextReadback = (nextReadback + 1) % readbacks.size();
+    }
+
+    // Collects the reads still in flight and waits for every frame to be written.
+    void finish(){
+        for (size_t i=0; i<readbacks.size(); i++){
+            Readback & readback = readbacks[(nextReadback + i) % readbacks.size()];
+            if (readback.isPending){
+                collect(readback);
+            }
+        }
+
+        {
+            lock_guard<mutex> lock(queueMutex);
+            isStopping = true;
+        }
+        queueChanged.notify_all();
+
+        for (auto & encoder : encoders){
+            encoder.join();
+        }
+        encoders.clear();
+    }
+
+    // The last frame drawn, e.g. for a preview.
+    const ofTexture & getTexture() const{
+        return fbo.getTexture();
+    }
+
+    size_t getNumFramesWritten() const{
+        return numFramesWritten;
+    }
+
+protected:
+    struct Readback {
+        ofBufferObject buffer;
+        GLsync fence = nullptr;
+        uint64_t frameNum = 0;
+        bool isPending = false;
+    };
+
+    struct Job {
+        ofPixels pixels;
+        uint64_t frameNum = 0;
+    };
+
+    // Frames waiting for an encoder, at most, per encoder thread.
+    const size_t MaxQueuedFramesPerEncoder = 2;
+
+    void collect(Readback & readback){
+        glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, numeric_limits<GLuint64>::max());
+        glDeleteSync(readback.fence);
+        readback.fence = nullptr;
+        readback.isPending = false;
+
+        Job job;
+        job.frameNum = readback.frameNum;
+
+        {
+            // Wait for room in the queue, then reuse the pixels of a written frame.
+            unique_lock<mutex> lock(queueMutex);
+            queueChanged.wait(lock, [this]{
+                return jobs.size() < MaxQueuedFramesPerEncoder * encoders.size();
+            });
+
+            if (!spareFrames.empty()){
+                job.pixels.swap(spareFrames.back());
+                spareFrames.pop_back();
+            }
+        }
+
+        if (!job.pixels.isAllocated()){
+            job.pixels.allocate(settings.width, settings.height, OF_PIXELS_RGB);
+        }
+
+        const unsigned char * data = readback.buffer.map<unsigned char>(GL_READ_ONLY);
+        if (data != nullptr){
+            memcpy(job.pixels.getData(), data, numBytesPerFrame);
+        }else{
+            ofLogWarning() << "FrameExporter::end() Couldn't map the pixels of frame " << job.frameNum << endl;
+        }
+        readback.buffer.unmap();
+
+        {
+            lock_guard<mutex> lock(queueMutex);
+            jobs.push_back(move(job));
+        }
+        queueChanged.notify_all();
+    }
+
+    void encodeLoop(){
+        while (true){
+            Job job;
+
+            {
+                unique_lock<mutex> lock(queueMutex);
+                queueChanged.wait(lock, [this]{
+                    return isStopping || !jobs.empty();
+                });
+
+                if (jobs.empty()){
+                    return;
+                }
+
+                job = move(jobs.front());
+                jobs.pop_front();
+            }
+            queueChanged.notify_all();
+
+            write(job);
+
+            {
+                lock_guard<mutex> lock(queueMutex);
+                spareFrames.push_back(move(job.pixels));
+                numFramesWritten++;
+            }
+        }
+    }
+
+    void write(const Job & job){
+        string path = directory + "/frame_" + ofToString(job.frameNum, 6, '0');
+
+        if (settings.format == Format::Png){
+            ofSaveImage(job.pixels, path + ".png");
+        }else{
+            ofstream file(path + ".raw", ios::binary);
+            file.write(reinterpret_cast<const char *>(job.pixels.getData()), numBytesPerFrame);
+
+            if (!file){
+                ofLogWarning() << "FrameExporter Couldn't write " << path << ".raw" << endl;
+            }
+        }
+    }
+
+    Settings settings;
+    string directory;
+    ofFbo fbo;
+    size_t numBytesPerFrame = 0;
+    vector<Readback> readbacks;
+    size_t nextReadback = 0;
+
+    vector<thread> encoders;
+    mutex queueMutex;
+    condition_variable queueChanged;
+    deque<Job> jobs;
+    vector<ofPixels> spareFrames;
+    bool isStopping = false;
+    atomic<size_t> numFramesWritten {0};
+};
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ContourPath.h"
+
+// Tessellated meshes, contour paths and decimated outlines of glyphs, keyed by font, size
+// and glyph, so that every text set in the same font shares the work and nothing is
+// tessellated twice.
+// Glyphs are kept with the pen at the origin; a Letter places one in a string.
+// Main thread only: ofPath tessellates with a tessellator shared by all paths, and fonts
+// share one FreeType library, neither of which a lock of the cache's own could guard.
+class GlyphCache {
+public:
+    struct Glyph {
+        shared_ptr<const ofMesh> mesh;
+        shared_ptr<const ContourPath> contourPath;
+
+        // Decimated outlines by minimum point distance.
+        map< float, shared_ptr<const vector<ofVec3f>> > points;
+    };
+
+    // A glyph placed in a string.
+    struct Letter {
+        shared_ptr<Glyph> glyph;
+        ofVec3f offset;
+        // The glyph's mesh and contour path moved to offset.
+        shared_ptr<const ofMesh> mesh;
+        shared_ptr<const ContourPath> contourPath;
+    };
+
+    // One letter per path of font.getStringAsPoints(text, false), in the same order and at
+    // the same positions.
+    vector<Letter> getLetters(const ofTrueTypeFont &font, const string &fontName, int fontSize, const string &text){
+        vector<ofPath> letterPaths = font.getStringAsPoints(text, false);
+        vector<uint32_t> characters = getOutlinedCharacters(text);
+        vector<Letter> letters;
+
+
+        for (size_t i=0; i<letterPaths.size(); i++){
+            Letter letter;
+
+            if (characters.size() == letterPaths.size()){
+                shared_ptr<Glyph> glyph;
+                ofPath glyphPath;
+                tie(glyph, glyphPath) = getGlyph(font, fontName, fontSize, characters[i]);
+
+                // The string's path is the glyph's path moved to the pen position.
+                auto & commands = letterPaths[i].getCommands();
+                auto & glyphCommands = glyphPath.getCommands();
+
+                if (commands.size() == glyphCommands.size() && commands.size() > 0){
+                    letter.glyph = glyph;
+                    letter.offset = commands[0].to - glyphCommands[0].to;
+                }
+            }
+
+            // Letters that can't be matched to a glyph are tessellated where they are.
+            if (letter.glyph == nullptr){
+                letter.glyph = makeGlyph(letterPaths[i]);
+            }
+
+            if (letter.offset == ofVec3f(0, 0, 0)){
+                letter.mesh = letter.glyph->mesh;
+                letter.contourPath = letter.glyph->contourPath;
+            }else{
+                shared_ptr<ofMesh> mesh = make_shared<ofMesh>(*letter.glyph->mesh);
+                for (auto & vertex : mesh->getVertices()){
+                    vertex += letter.offset;
+                }
+                letter.mesh = mesh;
+                
+                shared_ptr<ContourPath> contourPath = make_shared<ContourPath>(*letter.glyph->contourPath);
+                contourPath->translate(letter.offset);
+                letter.contourPath = contourPath;
+            }
+
+            letters.push_back(letter);
+        }
+
+        return letters;
+    }
+
+    // The glyph's mesh vertices thinned out so that each point is more than minimumDistance
+    // from the previous one, in glyph space.
+    shared_ptr<const vector<ofVec3f>> getPoints(Glyph &glyph, float minimumDistance){
+
+        auto it = glyph.points.find(minimumDistance);
+        if (it != glyph.points.end()){
+            return it->second;
+        }
+
+        shared_ptr< vector<ofVec3f> > points = make_shared< vector<ofVec3f> >();
+        const ofMesh &mesh = *glyph.mesh;
+
+        if (mesh.getNumVertices() > 0){
+            ofVec3f lastPoint = mesh.getVertex(0);
+            points->emplace_back(lastPoint);
+
+            for (ofIndexType j=1; j<mesh.getNumVertices(); ++j){
+                if (lastPoint.distance(mesh.getVertex(j)) > minimumDistance){
+                    lastPoint = mesh.getVertex(j);
+                    points->emplace_back(lastPoint);
+                }
+            }
+        }
+
+        glyph.points[minimumDistance] = points;
+        return points;
+    }
+
+protected:
+    struct Key {
+        string fontName;
+        int fontSize;
+        uint32_t character;
+
+        bool operator<(const Key &other) const{
+            return tie(fontName, fontSize, character) < tie(other.fontName, other.fontSize, other.character);
+        }
+    };
+
+    struct Entry {
+        shared_ptr<Glyph> glyph;
+        ofPath path;
+    };
+
+    pair< shared_ptr<Glyph>, ofPath > getGlyph(const ofTrueTypeFont &font, const string &fontName, int fontSize, uint32_t character){
+        Key key { fontName, fontSize, character };
+        auto it = glyphs.find(key);
+
+        if (it == glyphs.end()){
+            Entry entry;
+            entry.path = font.getCharacterAsPoints(character, false);
+            entry.glyph = makeGlyph(entry.path);
+            it = glyphs.insert(make_pair(key, entry)).first;
+        }
+
+        return make_pair(it->second.glyph, it->second.path);
+    }
+
+    static shared_ptr<Glyph> makeGlyph(ofPath &path){
+        shared_ptr<Glyph> glyph = make_shared<Glyph>();
+        glyph->mesh = make_shared<ofMesh>(path.getTessellation());
+        
+        shared_ptr<ContourPath> contourPath = make_shared<ContourPath>();
+        contourPath->setup(path.getOutline());
+        glyph->contourPath = contourPath;
+        
+        return glyph;
+    }
+
+    // The characters that getStringAsPoints() makes a path for, i.e. all but white space.
+    static vector<uint32_t> getOutlinedCharacters(const string &text){
+        vector<uint32_t> characters;
+
+        for (unsigned char c : text){
+            if (c != ' ' && c != '\n' && c != '\t' && c != '\r'){
+                characters.push_back(c);
+            }
+        }
+
+        return characters;
+    }
+
+    map<Key, Entry> glyphs;
+};
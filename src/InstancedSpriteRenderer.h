@@ -0,0 +1,252 @@
+#pragma once
+
+#include "ofMain.h"
+
+// What the instanced renderer needs to draw one sprite. Laid out to be streamed to the GPU
+// as is, four vec4 attributes per instance.
+struct SpriteInstance {
+    // Crumples are defined on a lattice of (CrumpleLatticeSize + 1)^2 points over the plane.
+    // A plane with n + 1 vertices a side, where n divides CrumpleLatticeSize, has its
+    // vertices on lattice points, so planes of different resolutions crumple alike. 48 is
+    // divided by both the 3 quads of SpriteVisualisationSource's planes and the 1 to 16 of
+    // InstancedSpriteRenderer's levels.
+    constexpr static int CrumpleLatticeSize = 48;
+
+    ofVec3f position;
+    // Picks the sprite's crumple, an integer below 2^24 so that it survives being a float.
+    float crumpleSeed = 0.f;
+    // ofNode's orientation for the sprite's Euler angles, see getOrientation().
+    ofVec4f orientation;
+    // The texture coordinates of the plane's corners, as passed to mapTexCoords().
+    ofVec4f texCoordRect;
+    ofVec2f size;
+    // 1 is flat, 0 is fully crumpled.
+    float homeness = 1.f;
+    // Set by InstancedSpriteRenderer, see there.
+    float lodMorph = 1.f;
+
+    // The quaternion ofNode::setOrientation() makes from Euler angles in degrees.
+    static ofVec4f getOrientation(ofVec3f orientationEuler){
+        ofQuaternion quaternion(orientationEuler.x, ofVec3f(1, 0, 0), orientationEuler.z, ofVec3f(0, 0, 1), orientationEuler.y, ofVec3f(0, 1, 0));
+        return quaternion.asVec4();
+    }
+
+    // The lattice point nearest to a vertex of a width by height plane centred on the origin.
+    static ofVec2f getCrumpleLatticePoint(ofVec3f vertex, float width, float height){
+        return ofVec2f(round((vertex.x / width + .5f) * CrumpleLatticeSize), round((vertex.y / height + .5f) * CrumpleLatticeSize));
+    }
+
+    // How far a crumpled sprite's vertex at latticePoint is moved from where it is on the
+    // flat plane, each axis in [0, maxDisplacement). instancedSprites.vert computes the
+    // same on the GPU.
+    static ofVec3f getCrumpleDisplacement(uint32_t crumpleSeed, ofVec2f latticePoint, float maxDisplacement){
+        uint32_t latticeIndex = uint32_t(latticePoint.y) * (CrumpleLatticeSize + 1) + uint32_t(latticePoint.x);
+        ofVec3f displacement;
+
+        for (uint32_t axis=0; axis<3; axis++){
+            uint32_t random = hash(crumpleSeed * 0x9e3779b9u + latticeIndex * 3 + axis) >> 8;
+            displacement[axis] = random / 16777216.f * maxDisplacement;
+        }
+
+        return displacement;
+    }
+
+    static uint32_t getRandomCrumpleSeed(){
+        return ofRandom(1 << 24);
+    }
+
+protected:
+    static uint32_t hash(uint32_t x){
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+};
+
+// Draws many sprites sharing a texture (e.g. an atlas) in the order given, with one
+// instanced draw call per run of consecutive sprites at the same level of detail. The
+// levels are unit planes of 1, 2, 4, 8 and 16 quads a side; each instance scales,
+// crumples, rotates and moves one in the vertex shader, which lights it like topLighting.
+// The level comes from how big the sprite is on screen and how crumpled it is, so distant
+// or flat sprites are a single quad and near, crumpled ones get all the folds. It is
+// continuous: a sprite just past a level's threshold gets the finer plane with its new
+// vertices morphed (lodMorph) onto the coarser plane's edges, moving out to their own
+// crumple as the sprite grows, so nothing pops when a sprite changes level.
+// Needs only GLSL 1.50 and instanced arrays, so it also runs on Mesa's software renderer.
+class InstancedSpriteRenderer {
+public:
+    void setup(){
+        shader.load("shaders_gl3/instancedSprites.vert", "shaders_gl3/topLighting.frag");
+
+        if (!shader.isLoaded()){
+            ofLogWarning() << "InstancedSpriteRenderer::setup() Couldn't load the instanced sprites shader" << endl;
+            return;
+        }
+
+        for (int level=0; level<NumLevels; level++){
+            setUpLevel(levels[level], 1 << level);
+        }
+
+        isSetUp = true;
+    }
+
+    bool isReady() const{
+        return isSetUp;
+    }
+
+    // For setting the lighting uniforms of topLighting, which keep their values between
+    // draws.
+    ofShader & getShader(){
+        return shader;
+    }
+
+    // Sets how many pixels on screen a quad of a crumpled sprite may cover before the
+    // sprite gets a finer plane.
+    void setPixelsPerQuad(float pixelsPerQuad){
+        this->pixelsPerQuad = pixelsPerQuad;
+    }
+
+    // Picks each instance's level with the current matrices and viewport, then streams and
+    // draws each run of instances at one level in one call, under the renderer's own
+    // shader. Instances are drawn in their order, e.g. back to front for blending; as level
+    // mostly follows distance, that order makes for long runs.
+    void draw(const ofTexture & texture, const vector<SpriteInstance> & instances){
+        if (!isSetUp || instances.empty()){
+            return;
+        }
+
+        ofMatrix4x4 modelView = ofGetCurrentMatrix(OF_MATRIX_MODELVIEW);
+        float pixelsPerUnitAtUnitDistance = ofGetCurrentMatrix(OF_MATRIX_PROJECTION)(1, 1) * ofGetViewportHeight() * .5f;
+
+        levelledInstances.clear();
+        runs.clear();
+
+        for (auto & instance : instances){
+            float distance = -(modelView(0, 2) * instance.position.x + modelView(1, 2) * instance.position.y + modelView(2, 2) * instance.position.z + modelView(3, 2));
+            float pixelSize = distance > 0.f ? max(instance.size.x, instance.size.y) * pixelsPerUnitAtUnitDistance / distance : numeric_limits<float>::max();
+
+            // Level 0 covers detail up to 0, level l > 0 detail in (l - 1, l].
+            float detail = log2(max(pixelSize * (1.f - instance.homeness) / pixelsPerQuad, 1.f));
+            detail = ofClamp(detail, 0.f, NumLevels - 1);
+            int level = ceil(detail);
+
+            levelledInstances.push_back(instance);
+            levelledInstances.back().lodMorph = level > 0 ? detail - (level - 1) : 1.f;
+
+            if (runs.empty() || runs.back().level != level){
+                runs.push_back({ level, levelledInstances.size() - 1, 0 });
+            }
+            runs.back().numInstances++;
+        }
+
+        shader.begin();
+        texture.bind();
+
+        for (auto & run : runs){
+            Level & level = levels[run.level];
+
+            // Respecifying the whole buffer lets the driver hand over fresh memory rather
+            // than wait for the last draw from it to finish.
+            level.instanceBuffer.allocate(sizeof(SpriteInstance) * run.numInstances, &levelledInstances[run.firstInstance], GL_STREAM_DRAW);
+            level.vbo.drawElementsInstanced(GL_TRIANGLES, level.numIndices, run.numInstances);
+        }
+
+        texture.unbind();
+        shader.end();
+    }
+
+protected:
+    const static int NumLevels = 5;
+    const static size_t InitialNumInstances = 1024;
+
+    struct Level {
+        ofVbo vbo;
+        ofBufferObject instanceBuffer;
+        int numIndices = 0;
+    };
+
+    // Consecutive instances at one level.
+    struct Run {
+        int level;
+        size_t firstInstance;
+        size_t numInstances;
+    };
+
+    // A unit plane of numQuads by numQuads quads, with each quad split along the diagonal
+    // from its lowest lattice point, so that the midpoint of a coarser quad lies on that
+    // diagonal. Each vertex carries its lattice point and the offset to the two lattice
+    // points it lies halfway between on the next coarser plane (none for vertices the
+    // coarser plane has too).
+    void setUpLevel(Level & level, int numQuads){
+        // Starts from ofPlanePrimitive for the same positions and texture coordinates.
+        ofPlanePrimitive plane;
+        plane.set(1.f, 1.f, numQuads + 1, numQuads + 1);
+        plane.mapTexCoords(0.f, 0.f, 1.f, 1.f);
+        ofMesh mesh = plane.getMesh();
+
+        int step = SpriteInstance::CrumpleLatticeSize / numQuads;
+        vector<int> vertexAt((numQuads + 1) * (numQuads + 1), 0);
+        vector<ofVec4f> latticePoints(mesh.getNumVertices());
+
+        for (size_t i=0; i<mesh.getNumVertices(); i++){
+            ofVec2f point = SpriteInstance::getCrumpleLatticePoint(mesh.getVertex(i), 1.f, 1.f);
+            int column = point.x / step;
+            int row = point.y / step;
+            vertexAt[row * (numQuads + 1) + column] = i;
+
+            // Odd columns and rows are new at this level.
+            latticePoints[i] = ofVec4f(point.x, point.y, (column % 2) * step, (row % 2) * step);
+        }
+
+        mesh.clearIndices();
+        mesh.setMode(OF_PRIMITIVE_TRIANGLES);
+
+        for (int row=0; row<numQuads; row++){
+            for (int column=0; column<numQuads; column++){
+                int corner00 = vertexAt[row * (numQuads + 1) + column];
+                int corner10 = vertexAt[row * (numQuads + 1) + column + 1];
+                int corner01 = vertexAt[(row + 1) * (numQuads + 1) + column];
+                int corner11 = vertexAt[(row + 1) * (numQuads + 1) + column + 1];
+
+                mesh.addTriangle(corner00, corner10, corner11);
+                mesh.addTriangle(corner00, corner11, corner01);
+            }
+        }
+
+        level.vbo.setMesh(mesh, GL_STATIC_DRAW);
+        level.numIndices = mesh.getNumIndices();
+
+        int latticeLocation = shader.getAttributeLocation("crumpleLatticePoint");
+        if (latticeLocation >= 0){
+            level.vbo.setAttributeData(latticeLocation, &latticePoints[0].x, 4, latticePoints.size(), GL_STATIC_DRAW, sizeof(ofVec4f));
+        }
+
+        level.instanceBuffer.allocate(sizeof(SpriteInstance) * InitialNumInstances, GL_STREAM_DRAW);
+        setUpInstanceAttribute(level, "instancePositionAndSeed", offsetof(SpriteInstance, position));
+        setUpInstanceAttribute(level, "instanceOrientation", offsetof(SpriteInstance, orientation));
+        setUpInstanceAttribute(level, "instanceTexCoordRect", offsetof(SpriteInstance, texCoordRect));
+        setUpInstanceAttribute(level, "instanceSizeHomenessAndMorph", offsetof(SpriteInstance, size));
+    }
+
+    void setUpInstanceAttribute(Level & level, const string & name, size_t offset){
+        int location = shader.getAttributeLocation(name);
+
+        if (location < 0){
+            ofLogWarning() << "InstancedSpriteRenderer::setup() The shader has no attribute " << name << endl;
+            return;
+        }
+
+        level.vbo.setAttributeBuffer(location, level.instanceBuffer, 4, sizeof(SpriteInstance), offset);
+        level.vbo.setAttributeDivisor(location, 1);
+    }
+
+    ofShader shader;
+    Level levels[NumLevels];
+    vector<SpriteInstance> levelledInstances;
+    vector<Run> runs;
+    float pixelsPerQuad = 16.f;
+    bool isSetUp = false;
+};
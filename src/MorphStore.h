@@ -0,0 +1,107 @@
+#pragma once
+
+#include "ofMain.h"
+#include "Simd.h"
+
+// Vertex positions of many same-sized meshes that morph between two shapes, e.g. flat and
+// crumpled paper sprites. Per mesh it keeps only the home positions and the deltas to the
+// morph target, in one contiguous array for all meshes; indices, texture coordinates and
+// normals stay with the meshes that are drawn. Each mesh has its own homeness (1 is home,
+// 0 is fully morphed). update() recomputes the positions of the meshes whose homeness
+// changed in one pass, eight floats at a time, and leaves the others alone.
+class MorphStore {
+public:
+    // Returns the mesh's slot. Every mesh added must have the same number of vertices.
+    // Starts fully morphed, i.e. at morphedVertices.
+    size_t add(const vector<ofVec3f> & homeVertices, const vector<ofVec3f> & morphedVertices){
+        if (numSlots == 0){
+            numVertices = homeVertices.size();
+            stride = (numVertices * 3 + Float8::Width - 1) / Float8::Width * Float8::Width;
+        }
+
+        if (homeVertices.size() != numVertices || morphedVertices.size() != numVertices){
+            ofLogWarning() << "MorphStore::add() Meshes must all have " << numVertices << " vertices" << endl;
+        }
+
+        size_t slot = numSlots++;
+        homePositions.resize(numSlots * stride, 0.f);
+        deltas.resize(numSlots * stride, 0.f);
+        positions.resize(numSlots * stride, 0.f);
+        homeness.push_back(0.f);
+        isSlotDirty.push_back(false);
+        versions.push_back(1);
+
+        size_t count = min(numVertices, min(homeVertices.size(), morphedVertices.size()));
+        for (size_t v=0; v<count; v++){
+            for (int axis=0; axis<3; axis++){
+                size_t k = slot * stride + v * 3 + axis;
+                homePositions[k] = homeVertices[v][axis];
+                deltas[k] = morphedVertices[v][axis] - homeVertices[v][axis];
+                positions[k] = morphedVertices[v][axis];
+            }
+        }
+
+        return slot;
+    }
+
+    void setHomeness(size_t slot, float normalisedHomeness){
+        if (homeness[slot] == normalisedHomeness){
+            return;
+        }
+
+        homeness[slot] = normalisedHomeness;
+        isSlotDirty[slot] = true;
+        isDirty = true;
+    }
+
+    // Cheap if no homeness changed since the last call.
+    void update(){
+        if (!isDirty){
+            return;
+        }
+
+        for (size_t slot=0; slot<numSlots; slot++){
+            if (!isSlotDirty[slot]){
+                continue;
+            }
+
+            Float8 morphedness = Float8::broadcast(1.f - homeness[slot]);
+            size_t begin = slot * stride;
+
+            for (size_t k=begin; k<begin+stride; k+=Float8::Width){
+                (Float8::load(&homePositions[k]) + Float8::load(&deltas[k]) * morphedness).store(&positions[k]);
+            }
+
+            isSlotDirty[slot] = false;
+            versions[slot]++;
+        }
+
+        isDirty = false;
+    }
+
+    size_t getNumVertices() const{
+        return numVertices;
+    }
+
+    // numVertices consecutive x, y, z triples as of the last update().
+    const float * getPositions(size_t slot) const{
+        return &positions[slot * stride];
+    }
+
+    // Changes whenever update() changes the slot's positions.
+    unsigned int getVersion(size_t slot) const{
+        return versions[slot];
+    }
+
+protected:
+    size_t numSlots = 0;
+    size_t numVertices = 0;
+    // Floats per slot, padded to a multiple of Float8::Width.
+    size_t stride = 0;
+
+    vector<float> homePositions, deltas, positions;
+    vector<float> homeness;
+    vector<bool> isSlotDirty;
+    vector<unsigned int> versions;
+    bool isDirty = false;
+};
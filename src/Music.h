@@ -2,6 +2,10 @@
 
 #include "ofMain.h"
 
+// The music's level, smoothed over time. Either plays the music and follows the spectrum
+// of what is playing, or, after setupOffline(), plays nothing and looks the level up in
+// levels worked out from the file, so that it is the same on every run, e.g. when
+// rendering offline.
 class Music {
 public:
     void setup(string musicFile){
@@ -16,11 +20,180 @@ public:
         level = level * smoothing + (1-smoothing) * newLevel;
     }
     
+    // Works out the level update() would have at each of updatesPerSecond updates a second
+    // from the start of musicFile, an uncompressed WAV. ofSoundGetSpectrum(1) is FMOD's
+    // lowest band of a 64 band spectrum, which is approximated here from a Hann window of
+    // the samples mixed down to mono. Returns false, leaving the level at silence, if the
+    // file can't be read.
+    bool setupOffline(string musicFile, float updatesPerSecond){
+        level = 0.f;
+        offlineLevels.clear();
+        this->updatesPerSecond = updatesPerSecond;
+        
+        vector<float> samples;
+        int sampleRate = 0;
+        
+        if (!loadWav(musicFile, samples, sampleRate)){
+            ofLogWarning() << "Music::setupOffline() Couldn't read " << musicFile << " as an uncompressed WAV" << endl;
+            return false;
+        }
+        
+        vector<float> window(SpectrumWindowSize);
+        float windowSum = 0.f;
+        
+        for (int i=0; i<SpectrumWindowSize; i++){
+            window[i] = .5f - .5f * cos(TWO_PI * i / (SpectrumWindowSize - 1));
+            windowSum += window[i];
+        }
+        
+        double samplesPerUpdate = sampleRate / double(updatesPerSecond);
+        size_t numUpdates = size_t(samples.size() / samplesPerUpdate) + 1;
+        offlineLevels.resize(numUpdates);
+        float smoothedLevel = 0.f;
+        
+        for (size_t updateNum=0; updateNum<numUpdates; updateNum++){
+            // The window of samples up to the update's time.
+            int64_t end = llround(updateNum * samplesPerUpdate);
+            float band = 0.f;
+            
+            for (int i=0; i<SpectrumWindowSize; i++){
+                int64_t sample = end - SpectrumWindowSize + i;
+                if (sample >= 0 && sample < int64_t(samples.size())){
+                    band += window[i] * samples[sample];
+                }
+            }
+            
+            // In decibels as ofSoundGetSpectrum() returns it.
+            float newLevel = 20.f * log10(1.f + fabs(band) / windowSum);
+            smoothedLevel = smoothedLevel * smoothing + (1-smoothing) * newLevel;
+            offlineLevels[updateNum] = smoothedLevel;
+        }
+        
+        return true;
+    }
+    
+    // Sets the level to the one at time, in seconds from the start of the music, after
+    // setupOffline(). Past the end it fades out as update() would with nothing playing.
+    void seek(double time){
+        if (offlineLevels.empty() || time < 0.){
+            level = 0.f;
+            return;
+        }
+        
+        size_t updateNum = size_t(floor(time * updatesPerSecond + UpdateTolerance));
+        
+        if (updateNum < offlineLevels.size()){
+            level = offlineLevels[updateNum];
+        }else{
+            level = offlineLevels.back() * pow(smoothing, float(updateNum - (offlineLevels.size() - 1)));
+        }
+    }
+    
     float getLevel(){
         return level;
     }
-    
+
 private:
+    const int SpectrumWindowSize = 128;
+    // Times from whole update counts still fall on their update after rounding.
+    const double UpdateTolerance = .001;
+    
+    static uint32_t readUint16(const unsigned char * bytes){
+        return bytes[0] | (bytes[1] << 8);
+    }
+    
+    static uint32_t readUint32(const unsigned char * bytes){
+        return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (uint32_t(bytes[3]) << 24);
+    }
+    
+    // A little-endian PCM or float sample, in [-1, 1].
+    static float readSample(const unsigned char * bytes, int bitsPerSample, bool isFloat){
+        if (isFloat){
+            float sample;
+            memcpy(&sample, bytes, sizeof(sample));
+            return sample;
+        }
+        
+        switch (bitsPerSample){
+            case 8:
+                return (bytes[0] - 128) / 128.f;
+            case 16:
+                return int16_t(readUint16(bytes)) / 32768.f;
+            case 24:{
+                int32_t sample = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16);
+                return (sample >= 0x800000 ? sample - 0x1000000 : sample) / 8388608.f;
+            }
+            default:
+                return int32_t(readUint32(bytes)) / 2147483648.f;
+        }
+    }
+    
+    // Reads an uncompressed WAV into samples mixed down to mono.
+    static bool loadWav(const string & musicFile, vector<float> & samples, int & sampleRate){
+        ofBuffer buffer = ofBufferFromFile(musicFile, true);
+        const unsigned char * data = reinterpret_cast<const unsigned char *>(buffer.getData());
+        size_t size = buffer.size();
+        
+        if (size < 12 || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0){
+            return false;
+        }
+        
+        int format = 0;
+        int numChannels = 0;
+        int bitsPerSample = 0;
+        size_t position = 12;
+        
+        while (position + 8 <= size){
+            const unsigned char * chunk = data + position;
+            size_t chunkSize = readUint32(chunk + 4);
+            const unsigned char * body = chunk + 8;
+            size_t bodySize = min(chunkSize, size - position - 8);
+            
+            if (memcmp(chunk, "fmt ", 4) == 0 && bodySize >= 16){
+                format = readUint16(body);
+                numChannels = readUint16(body + 2);
+                sampleRate = readUint32(body + 4);
+                bitsPerSample = readUint16(body + 14);
+                
+                // WAVE_FORMAT_EXTENSIBLE has the actual format at the start of its sub format.
+                if (format == 0xfffe && bodySize >= 26){
+                    format = readUint16(body + 24);
+                }
+            }else if (memcmp(chunk, "data", 4) == 0){
+                bool isFloat = format == 3 && bitsPerSample == 32;
+                bool isPcm = format == 1 && (bitsPerSample == 8 || bitsPerSample == 16 || bitsPerSample == 24 || bitsPerSample == 32);
+                
+                if ((!isFloat && !isPcm) || numChannels <= 0 || sampleRate <= 0){
+                    return false;
+                }
+                
+                size_t bytesPerSample = bitsPerSample / 8;
+                size_t numFrames = bodySize / (bytesPerSample * numChannels);
+                samples.assign(numFrames, 0.f);
+                
+                for (size_t frame=0; frame<numFrames; frame++){
+                    const unsigned char * frameBytes = body + frame * bytesPerSample * numChannels;
+                    
+                    for (int channel=0; channel<numChannels; channel++){
+                        samples[frame] += readSample(frameBytes + channel * bytesPerSample, bitsPerSample, isFloat);
+                    }
+                    
+                    samples[frame] /= numChannels;
+                }
+                
+                return true;
+            }
+            
+            // Chunks are padded to an even size.
+            position += 8 + chunkSize + (chunkSize & 1);
+        }
+        
+        return false;
+    }
+    
     ofSoundPlayer soundPlayer;
-    float level, smoothing;
-};
\ No newline at end of file
+    float level = 0.f;
+    float smoothing = .95f;
+    vector<float> offlineLevels;
+    float updatesPerSecond = 60.f;
+};
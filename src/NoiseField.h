@@ -0,0 +1,155 @@
+#pragma once
+
+#include "ofMain.h"
+#include "Simd.h"
+#include "WorkerPool.h"
+
+// A column of gradient noise values, value(i) = noise(i * scale, y, time), mapped to
+// [0, 1] like ofNoise(). It is classic 3D gradient (Perlin) noise rather than the simplex
+// noise behind ofNoise(), because with the lattice aligned to the axes everything that
+// depends on x and y is fixed per index. For each index the cache holds the xy-interpolated
+// gradient terms of the two time planes around the current time, so a frame only has to
+// evaluate a couple of multiply-adds per index, eight indices at a time. The cache is
+// rebuilt when time crosses into the next lattice cell, i.e. once per unit of time.
+class NoiseField {
+public:
+    // Cheap if nothing changed, so it can be called every frame.
+    void setup(size_t count, float scale, float y){
+        if (count == this->count && scale == this->scale && y == this->y){
+            return;
+        }
+
+        this->count = count;
+        this->scale = scale;
+        this->y = y;
+
+        size_t paddedCount = (count + Float8::Width - 1) / Float8::Width * Float8::Width;
+        planeOffsets0.assign(paddedCount, 0.f);
+        planeSlopes0.assign(paddedCount, 0.f);
+        planeOffsets1.assign(paddedCount, 0.f);
+        planeSlopes1.assign(paddedCount, 0.f);
+        values.assign(paddedCount, .5f);
+        isCacheValid = false;
+    }
+
+    // Evaluates every index at time. Pass a pool to rebuild the cache in parallel.
+    void update(float time, WorkerPool * pool = nullptr){
+        int timeCell = floor(time);
+
+        if (!isCacheValid || timeCell != cachedTimeCell){
+            cachedTimeCell = timeCell;
+            isCacheValid = true;
+
+            auto rebuild = [&](size_t begin, size_t end){
+                for (size_t i=begin; i<end; i++){
+                    rebuildIndex(i);
+                }
+            };
+
+            if (pool != nullptr){
+                pool->parallelFor(count, ChunkSize, rebuild);
+            }else{
+                rebuild(0, count);
+            }
+        }
+
+        float tz = time - timeCell;
+        Float8 fz = Float8::broadcast(tz);
+        Float8 fzMinusOne = Float8::broadcast(tz - 1.f);
+        Float8 w = Float8::broadcast(fade(tz));
+
+        for (size_t i=0; i<values.size(); i+=Float8::Width){
+            Float8 n0 = Float8::load(&planeOffsets0[i]) + Float8::load(&planeSlopes0[i]) * fz;
+            Float8 n1 = Float8::load(&planeOffsets1[i]) + Float8::load(&planeSlopes1[i]) * fzMinusOne;
+            Float8 n = n0 + (n1 - n0) * w;
+            (n * .5f + .5f).store(&values[i]);
+        }
+    }
+
+    // Normalised values from the last update(), one per index.
+    const float * getValues() const{
+        return values.data();
+    }
+
+    size_t size() const{
+        return count;
+    }
+
+protected:
+    const size_t ChunkSize = 4096;
+
+    static float fade(float t){
+        return t * t * t * (t * (t * 6.f - 15.f) + 10.f);
+    }
+
+    static uint32_t hash(int x, int y, int z){
+        uint32_t h = uint32_t(x) * 73856093u ^ uint32_t(y) * 19349663u ^ uint32_t(z) * 83492791u;
+        h ^= h >> 16;
+        h *= 0x7feb352du;
+        h ^= h >> 15;
+        h *= 0x846ca68bu;
+        h ^= h >> 16;
+        return h;
+    }
+
+    // One of the twelve cube edge gradients of improved Perlin noise.
+    static ofVec3f gradient(uint32_t h){
+        switch (h % 12){
+            case 0: return ofVec3f(1, 1, 0);
+            case 1: return ofVec3f(-1, 1, 0);
+            case 2: return ofVec3f(1, -1, 0);
+            case 3: return ofVec3f(-1, -1, 0);
+            case 4: return ofVec3f(1, 0, 1);
+            case 5: return ofVec3f(-1, 0, 1);
+            case 6: return ofVec3f(1, 0, -1);
+            case 7: return ofVec3f(-1, 0, -1);
+            case 8: return ofVec3f(0, 1, 1);
+            case 9: return ofVec3f(0, -1, 1);
+            case 10: return ofVec3f(0, 1, -1);
+            default: return ofVec3f(0, -1, -1);
+        }
+    }
+
+    // The noise at (x, y, z) is the fade-weighted blend of the dot products between the
+    // eight corner gradients and the offsets to the corners. Interpolating over x and y
+    // first leaves, for each time plane, a linear function offset + slope * (fz - dz).
+    void rebuildIndex(size_t i){
+        float x = i * scale;
+        int cellX = floor(x);
+        int cellY = floor(y);
+        float fx = x - cellX;
+        float fy = y - cellY;
+        float u = fade(fx);
+        float v = fade(fy);
+
+        for (int dz=0; dz<2; dz++){
+            float offsets[2][2], slopes[2][2];
+
+            for (int dy=0; dy<2; dy++){
+                for (int dx=0; dx<2; dx++){
+                    ofVec3f g = gradient(hash(cellX + dx, cellY + dy, cachedTimeCell + dz));
+                    offsets[dy][dx] = g.x * (fx - dx) + g.y * (fy - dy);
+                    slopes[dy][dx] = g.z;
+                }
+            }
+
+            float offset0 = offsets[0][0] + (offsets[0][1] - offsets[0][0]) * u;
+            float offset1 = offsets[1][0] + (offsets[1][1] - offsets[1][0]) * u;
+            float slope0 = slopes[0][0] + (slopes[0][1] - slopes[0][0]) * u;
+            float slope1 = slopes[1][0] + (slopes[1][1] - slopes[1][0]) * u;
+
+            (dz == 0 ? planeOffsets0 : planeOffsets1)[i] = offset0 + (offset1 - offset0) * v;
+            (dz == 0 ? planeSlopes0 : planeSlopes1)[i] = slope0 + (slope1 - slope0) * v;
+        }
+    }
+
+    size_t count = 0;
+    float scale = 0.f;
+    float y = 0.f;
+    bool isCacheValid = false;
+    int cachedTimeCell = 0;
+
+    // Padded to a multiple of Float8::Width.
+    vector<float> planeOffsets0, planeSlopes0, planeOffsets1, planeSlopes1;
+    vector<float> values;
+};
@@ -0,0 +1,235 @@
+#pragma once
+
+#include "ofMain.h"
+#include "Simd.h"
+#include "WorkerPool.h"
+#include "NoiseField.h"
+#include <random>
+
+// Particles drifting up from emitters, e.g. the sprites of
+// TornPaperWithParticlesVisualisation, shared by a whole scene. Particle state is kept in
+// flat arrays by slot, positions relative to their emitter. A particle that rises past
+// the upper limit dies and its slot goes on a free list, from which its emitter respawns
+// it near the emitter.
+// update() advances the particles in fixed steps of simulated time, so they move the same
+// however many frames are drawn. Emitters are told where they are alongside it, and
+// draw() draws every particle as a point in one call. Emitters that weren't told since
+// the last hideEmitters() (e.g. of agents that have gone) aren't drawn.
+// Pass a WorkerPool to update() and draw() to spread them over threads.
+class ParticleSystem {
+public:
+    // Sets how wobbly the particles' paths are, as the scale of the noise moving them.
+    void setNoiseScale(float noiseScale){
+        this->noiseScale = noiseScale;
+    }
+
+    void setPointSize(float pointSize){
+        this->pointSize = pointSize;
+    }
+
+    // Returns the emitter's index. Its particles start spread out below it.
+    size_t addEmitter(ofColor color, size_t numParticles){
+        Emitter emitter;
+        emitter.color = color;
+        emitter.numParticles = numParticles;
+        emitters.push_back(emitter);
+        size_t emitterIndex = emitters.size() - 1;
+
+        size_t firstSlot = numSlots;
+        resize(numSlots + numParticles);
+
+        for (size_t slot=firstSlot; slot<numSlots; slot++){
+            spawn(slot, emitterIndex, InitialMinY);
+        }
+
+        return emitterIndex;
+    }
+
+    // Where the emitter is to be drawn, and whether its particles are drawn at all.
+    void setEmitterPosition(size_t emitterIndex, ofVec3f position, bool isVisible){
+        emitters[emitterIndex].position = position;
+        emitters[emitterIndex].isVisible = isVisible;
+    }
+
+    // Hides every emitter until it is given a position again, e.g. before giving the
+    // emitters of a new frame's agents theirs.
+    void hideEmitters(){
+        for (auto & emitter : emitters){
+            emitter.isVisible = false;
+        }
+    }
+
+    // Catches up with time, in seconds, one step at a time.
+    void update(float time, WorkerPool * pool = nullptr){
+        if (!hasStarted){
+            startTime = time;
+            hasStarted = true;
+        }
+
+        // Steps are counted rather than summed up, so that the same time always means the
+        // same number of steps however it was reached.
+        int64_t targetNumSteps = floor((time - startTime) * StepsPerSecond + StepTolerance);
+
+        // After a long stall, skip ahead rather than spend several frames catching up.
+        numSteps = max(numSteps, targetNumSteps - MaxStepsPerUpdate);
+
+        while (numSteps < targetNumSteps){
+            numSteps++;
+            step(float(numSteps) / StepsPerSecond, pool);
+        }
+    }
+
+    void draw(WorkerPool * pool = nullptr){
+        if (numSlots == 0){
+            return;
+        }
+
+        vector<ofVec3f> & vertices = mesh.getVertices();
+        vector<ofFloatColor> & colors = mesh.getColors();
+        vertices.resize(numSlots);
+        colors.resize(numSlots);
+
+        // Dead and hidden particles are drawn transparent, so every particle keeps its
+        // vertex and the mesh can be filled in parallel.
+        forEachChunk(numSlots, ChunkSize, pool, [&](size_t begin, size_t end){
+            for (size_t slot=begin; slot<end; slot++){
+                const Emitter & emitter = emitters[emitterIndices[slot]];
+                float y = ys[slot];
+                float alpha = (isAlive[slot] && emitter.isVisible && y >= 0.f) ? ofMap(y, UpperLimit, 0.f, 0.f, 1.f, true) : 0.f;
+
+                vertices[slot] = emitter.position + ofVec3f(xs[slot], y, zs[slot]);
+                colors[slot] = emitter.color;
+                colors[slot].a = alpha;
+            }
+        });
+
+        mesh.setMode(OF_PRIMITIVE_POINTS);
+        glPointSize(pointSize);
+        mesh.draw();
+    }
+    
+    // How far from its emitter a particle can be drawn. Particles rise to the upper limit
+    // and rarely wander further than that sideways.
+    float getReach() const{
+        return UpperLimit + RespawnMaxY;
+    }
+
+    size_t getNumParticles() const{
+        return numSlots;
+    }
+
+protected:
+    const float StepsPerSecond = 60.f;
+    const float StepTolerance = .001f;
+    const int64_t MaxStepsPerUpdate = 4;
+    const size_t ChunkSize = 4096;
+    // Particles NoiseFieldSize slots apart follow the same noise. A multiple of
+    // Float8::Width.
+    const size_t NoiseFieldSize = 4096;
+    const float UpperLimit = 100.f;
+    const float InitialMinY = -200.f;
+    const float RespawnMinY = -10.f;
+    const float RespawnMaxY = 10.f;
+
+    struct Emitter {
+        ofVec3f position;
+        ofFloatColor color;
+        size_t numParticles = 0;
+        size_t numAlive = 0;
+        bool isVisible = false;
+    };
+
+    // Keeps the position arrays padded for Float8.
+    void resize(size_t numSlots){
+        this->numSlots = numSlots;
+        size_t paddedCount = (numSlots + Float8::Width - 1) / Float8::Width * Float8::Width;
+
+        xs.resize(paddedCount, 0.f);
+        ys.resize(paddedCount, 0.f);
+        zs.resize(paddedCount, 0.f);
+        emitterIndices.resize(numSlots, 0);
+        isAlive.resize(numSlots, false);
+    }
+
+    void spawn(size_t slot, size_t emitterIndex, float minY){
+        xs[slot] = getRandom(-10.f, 10.f);
+        ys[slot] = getRandom(minY, RespawnMaxY);
+        zs[slot] = 0.f;
+        emitterIndices[slot] = emitterIndex;
+        isAlive[slot] = true;
+        emitters[emitterIndex].numAlive++;
+    }
+
+    // Particles have their own generator, so that they don't depend on who else calls
+    // ofRandom() and when.
+    float getRandom(float min, float max){
+        return uniform_real_distribution<float>(min, max)(randomGenerator);
+    }
+
+    void step(float simulatedTime, WorkerPool * pool){
+        noiseField1.setup(NoiseFieldSize, noiseScale, 200.f * noiseScale);
+        noiseField2.setup(NoiseFieldSize, noiseScale, 1200.f * noiseScale);
+        noiseField1.update(simulatedTime, pool);
+        noiseField2.update(simulatedTime, pool);
+
+        const float * noiseValues1 = noiseField1.getValues();
+        const float * noiseValues2 = noiseField2.getValues();
+
+        forEachChunk(xs.size() / Float8::Width, ChunkSize / Float8::Width, pool, [&](size_t begin, size_t end){
+            Float8 half = Float8::broadcast(.5f);
+            Float8 one = Float8::broadcast(1.f);
+
+            for (size_t i=begin*Float8::Width; i<end*Float8::Width; i+=Float8::Width){
+                size_t noiseIndex = i % NoiseFieldSize;
+                (Float8::load(&xs[i]) + Float8::load(&noiseValues1[noiseIndex]) - half).store(&xs[i]);
+                (Float8::load(&ys[i]) + Float8::load(&noiseValues2[noiseIndex]) + one).store(&ys[i]);
+            }
+        });
+
+        for (size_t slot=0; slot<numSlots; slot++){
+            if (isAlive[slot] && ys[slot] > UpperLimit){
+                isAlive[slot] = false;
+                emitters[emitterIndices[slot]].numAlive--;
+                freeSlots.push_back(slot);
+            }
+        }
+
+        // Slots are reused by whichever emitter needs them, lowest emitter first.
+        for (size_t emitterIndex=0; emitterIndex<emitters.size() && !freeSlots.empty(); emitterIndex++){
+            Emitter & emitter = emitters[emitterIndex];
+
+            while (emitter.numAlive < emitter.numParticles && !freeSlots.empty()){
+                size_t slot = freeSlots.back();
+                freeSlots.pop_back();
+                spawn(slot, emitterIndex, RespawnMinY);
+            }
+        }
+    }
+
+    template<class Function>
+    void forEachChunk(size_t count, size_t grainSize, WorkerPool * pool, Function function){
+        if (pool != nullptr){
+            pool->parallelFor(count, grainSize, function);
+        }else{
+            function(0, count);
+        }
+    }
+
+    NoiseField noiseField1, noiseField2;
+    float noiseScale = .5f;
+    float pointSize = 2.f;
+    mt19937 randomGenerator;
+    float startTime = 0.f;
+    int64_t numSteps = 0;
+    bool hasStarted = false;
+
+    vector<Emitter> emitters;
+    size_t numSlots = 0;
+    // Relative to the emitter, padded to a multiple of Float8::Width.
+    vector<float> xs, ys, zs;
+    vector<uint32_t> emitterIndices;
+    vector<uint8_t> isAlive;
+    vector<size_t> freeSlots;
+
+    ofVboMesh mesh;
+};
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+
 class Poster {
 public:
     void setup(string imagePath){
@@ -51,6 +53,25 @@ public:
         return plane.getHeight();
     }
     
+    // Once fully animated in, nothing behind the poster shows through.
+    bool isOpaque(){
+        return animator.getValue() >= FinalAlpha;
+    }
+    
+    // The poster's corners in world space, going round.
+    array<ofVec3f, 4> getCorners(){
+        float halfWidth = plane.getWidth() * .5f;
+        float halfHeight = plane.getHeight() * .5f;
+        ofMatrix4x4 transform = plane.getGlobalTransformMatrix();
+        
+        return {{
+            ofVec3f(-halfWidth, -halfHeight, 0) * transform,
+            ofVec3f(halfWidth, -halfHeight, 0) * transform,
+            ofVec3f(halfWidth, halfHeight, 0) * transform,
+            ofVec3f(-halfWidth, halfHeight, 0) * transform
+        }};
+    }
+    
 protected:
     const float FinalAlpha = 255.f;
     const float AnimationTime = .8f;
@@ -0,0 +1,371 @@
+#pragma once
+
+#include "ofMain.h"
+#include "FboPool.h"
+#include <regex>
+
+// A frame's offscreen work as passes that declare what they read and write. Built anew
+// each frame (clear(), add targets and passes, compile(), execute()), which is cheap; only
+// the framebuffers and generated shaders are kept.
+// compile() drops passes whose output nothing uses and fuses runs of colour passes, which
+// only change each pixel's colour, into one pass with a generated shader. execute() takes
+// transient targets from an FboPool just before their first pass and gives them back
+// right after their last, so targets that are never alive at the same time share a
+// framebuffer, within the graph and with other graphs on the same pool.
+// Full screen passes overwrite their whole target with blending off, so they don't need
+// to clear it first; other passes say whether they want their target cleared.
+class RenderGraph {
+public:
+    typedef int Target;
+    // Whatever is being drawn to when execute() is called, e.g. the window.
+    const static Target Screen = -1;
+
+    void setFboPool(shared_ptr<FboPool> fboPool){
+        this->fboPool = fboPool;
+    }
+
+    // Forgets the passes and targets, keeping the pool and generated shaders.
+    void clear(){
+        targets.clear();
+        passes.clear();
+        isCompiled = false;
+    }
+
+    // A target that only lives while passes use it.
+    Target createTarget(const string & name, int width, int height, int internalFormat = GL_RGBA){
+        TargetInfo target;
+        target.name = name;
+        target.width = width;
+        target.height = height;
+        target.internalFormat = internalFormat;
+        targets.push_back(target);
+        return targets.size() - 1;
+    }
+
+    // A framebuffer that outlives the frame, e.g. one kept for the next frame. Passes
+    // writing to it are never dropped.
+    Target importTarget(const string & name, ofFbo & fbo){
+        Target target = createTarget(name, fbo.getWidth(), fbo.getHeight());
+        targets[target].fbo = &fbo;
+        targets[target].isImported = true;
+        return target;
+    }
+
+    int getWidth(Target target) const{
+        return target == Screen ? ofGetViewportWidth() : targets[target].width;
+    }
+
+    int getHeight(Target target) const{
+        return target == Screen ? ofGetViewportHeight() : targets[target].height;
+    }
+
+    // Only valid while the graph executes, e.g. in a pass that declared target as an input.
+    ofTexture & getTexture(Target target){
+        return targets[target].fbo->getTexture();
+    }
+
+    // draw is called with output bound (and cleared to clearColor if isClearing).
+    void addPass(const string & name, const vector<Target> & inputs, Target output, function<void()> draw, bool isClearing = false, ofFloatColor clearColor = ofFloatColor(0.f, 0.f)){
+        Pass pass;
+        pass.name = name;
+        pass.inputs = inputs;
+        pass.output = output;
+        pass.draw = draw;
+        pass.isClearing = isClearing;
+        pass.clearColor = clearColor;
+        passes.push_back(pass);
+    }
+
+    // Draws input over the whole of output through shader, after setUniforms(shader).
+    void addShaderPass(const string & name, Target input, Target output, ofShader & shader, function<void(ofShader &)> setUniforms = nullptr){
+        addPass(name, {input}, output, [this, input, output, &shader, setUniforms]{
+            shader.begin();
+            if (setUniforms){
+                setUniforms(shader);
+            }
+            drawFullScreen(getTexture(input), output);
+            shader.end();
+        });
+        passes.back().isFullScreen = true;
+    }
+
+    // A pass that maps each pixel's colour on its own, e.g. grading. glslFunction defines
+    // vec4 apply(vec4 color) in GLSL 1.50, with any uniforms it needs, which must be named
+    // apart from other colour passes' as fused passes share a shader. setUniforms is called
+    // with whichever shader the pass ends up in.
+    void addColorPass(const string & name, Target input, Target output, const string & glslFunction, function<void(ofShader &)> setUniforms = nullptr){
+        addPass(name, {input}, output, nullptr);
+        passes.back().isFullScreen = true;
+        passes.back().colorFunctions.push_back({glslFunction, setUniforms});
+    }
+
+    void compile(){
+        fuseColorPasses();
+        cullPasses();
+
+        for (auto & target : targets){
+            target.lastPass = -1;
+        }
+
+        for (size_t p=0; p<passes.size(); p++){
+            if (passes[p].isCulled){
+                continue;
+            }
+
+            for (Target input : passes[p].inputs){
+                if (input == passes[p].output){
+                    ofLogWarning() << "RenderGraph::compile() Pass " << passes[p].name << " reads the target it writes" << endl;
+                }
+                if (input != Screen){
+                    targets[input].lastPass = p;
+                }
+            }
+
+            if (passes[p].output != Screen){
+                targets[passes[p].output].lastPass = max<int>(targets[passes[p].output].lastPass, p);
+            }
+
+            if (!passes[p].colorFunctions.empty()){
+                passes[p].shader = getColorShader(passes[p].colorFunctions);
+            }
+        }
+
+        isCompiled = true;
+    }
+
+    void execute(){
+        if (!isCompiled){
+            compile();
+        }
+
+        if (fboPool == nullptr){
+            fboPool = make_shared<FboPool>();
+        }
+
+        numExecutedPasses = 0;
+
+        for (size_t p=0; p<passes.size(); p++){
+            Pass & pass = passes[p];
+
+            if (pass.isCulled){
+                continue;
+            }
+
+            ofFbo * fbo = nullptr;
+
+            if (pass.output != Screen){
+                TargetInfo & output = targets[pass.output];
+                if (output.fbo == nullptr){
+                    output.fbo = fboPool->acquire(output.width, output.height, output.internalFormat);
+                }
+                fbo = output.fbo;
+                fbo->begin();
+            }
+
+            if (pass.isClearing){
+                ofClear(ofColor(pass.clearColor));
+            }
+
+            if (pass.isFullScreen){
+                ofPushStyle();
+                ofDisableAlphaBlending();
+            }
+
+            if (pass.colorFunctions.empty()){
+                pass.draw();
+            }else{
+                drawColorPass(pass);
+            }
+
+            if (pass.isFullScreen){
+                ofPopStyle();
+            }
+
+            if (fbo != nullptr){
+                fbo->end();
+            }
+
+            numExecutedPasses++;
+            releaseTargetsEndingAt(p);
+        }
+    }
+
+    // From the last compile() and execute().
+    int getNumExecutedPasses() const{
+        return numExecutedPasses;
+    }
+
+    int getNumFusedPasses() const{
+        return numFusedPasses;
+    }
+
+protected:
+    struct TargetInfo {
+        string name;
+        int width = 0;
+        int height = 0;
+        int internalFormat = GL_RGBA;
+        ofFbo * fbo = nullptr;
+        bool isImported = false;
+        bool isUsed = false;
+        int lastPass = -1;
+    };
+
+    struct ColorFunction {
+        string glsl;
+        function<void(ofShader &)> setUniforms;
+    };
+
+    struct Pass {
+        string name;
+        vector<Target> inputs;
+        Target output = Screen;
+        function<void()> draw;
+        bool isClearing = false;
+        ofFloatColor clearColor;
+        bool isFullScreen = false;
+        bool isCulled = false;
+        vector<ColorFunction> colorFunctions;
+        shared_ptr<ofShader> shader;
+    };
+
+    // A colour pass reading the transient output of the colour pass just before it, and
+    // the only pass to read it, is folded into that pass, which then writes its output.
+    void fuseColorPasses(){
+        numFusedPasses = 0;
+
+        for (size_t p=1; p<passes.size(); p++){
+            Pass & previous = passes[p - 1];
+            Pass & pass = passes[p];
+
+            if (previous.isCulled || previous.colorFunctions.empty() || pass.colorFunctions.empty()){
+                continue;
+            }
+
+            Target intermediate = previous.output;
+            if (pass.inputs[0] != intermediate || intermediate == Screen || targets[intermediate].isImported || getNumReaders(intermediate) != 1){
+                continue;
+            }
+
+            // The fused pass takes the later one's place, keeping the order of writes to
+            // its output.
+            pass.inputs = previous.inputs;
+            pass.colorFunctions.insert(pass.colorFunctions.begin(), previous.colorFunctions.begin(), previous.colorFunctions.end());
+            pass.name = previous.name + "+" + pass.name;
+            previous.isCulled = true;
+            numFusedPasses++;
+        }
+    }
+
+    int getNumReaders(Target target) const{
+        int numReaders = 0;
+
+        for (auto & pass : passes){
+            if (!pass.isCulled){
+                numReaders += count(pass.inputs.begin(), pass.inputs.end(), target);
+            }
+        }
+
+        return numReaders;
+    }
+
+    // Walks back from the passes with outputs that outlive the graph, marking what they
+    // need. Anything else is dropped.
+    void cullPasses(){
+        for (auto & target : targets){
+            target.isUsed = target.isImported;
+        }
+
+        for (int p=passes.size()-1; p>=0; p--){
+            Pass & pass = passes[p];
+
+            if (pass.isCulled){
+                continue;
+            }
+
+            bool isNeeded = pass.output == Screen || targets[pass.output].isUsed;
+            pass.isCulled = !isNeeded;
+
+            if (isNeeded){
+                for (Target input : pass.inputs){
+                    if (input != Screen){
+                        targets[input].isUsed = true;
+                    }
+                }
+            }
+        }
+    }
+
+    void releaseTargetsEndingAt(int passIndex){
+        for (auto & target : targets){
+            if (target.lastPass == passIndex && !target.isImported && target.fbo != nullptr){
+                fboPool->release(target.fbo);
+                target.fbo = nullptr;
+            }
+        }
+    }
+
+    void drawFullScreen(ofTexture & texture, Target output){
+        texture.draw(0.f, 0.f, getWidth(output), getHeight(output));
+    }
+
+    void drawColorPass(Pass & pass){
+        if (pass.shader == nullptr || !pass.shader->isLoaded()){
+            drawFullScreen(getTexture(pass.inputs[0]), pass.output);
+            return;
+        }
+
+        pass.shader->begin();
+        for (auto & function : pass.colorFunctions){
+            if (function.setUniforms){
+                function.setUniforms(*pass.shader);
+            }
+        }
+        drawFullScreen(getTexture(pass.inputs[0]), pass.output);
+        pass.shader->end();
+    }
+
+    // Samples the input once and applies each function in turn, with each apply() renamed
+    // apart. Shaders are kept by source, so rebuilding the graph doesn't relink them.
+    shared_ptr<ofShader> getColorShader(const vector<ColorFunction> & functions){
+        stringstream source;
+        source << "#version 150\n\nuniform sampler2DRect source;\n\nin vec2 texCoordVarying;\n\nout vec4 fragColor;\n\n";
+
+        for (size_t i=0; i<functions.size(); i++){
+            source << regex_replace(functions[i].glsl, regex("\\bapply\\b"), "apply" + ofToString(i)) << "\n\n";
+        }
+
+        source << "void main() {\n    vec4 color = texture(source, texCoordVarying);\n";
+        for (size_t i=0; i<functions.size(); i++){
+            source << "    color = apply" << i << "(color);\n";
+        }
+        source << "    fragColor = color;\n}\n";
+
+        string fragmentSource = source.str();
+        auto cached = colorShaders.find(fragmentSource);
+        if (cached != colorShaders.end()){
+            return cached->second;
+        }
+
+        auto shader = make_shared<ofShader>();
+        shader->setupShaderFromSource(GL_VERTEX_SHADER, ofBufferFromFile("shaders_gl3/passThrough.vert").getText());
+        shader->setupShaderFromSource(GL_FRAGMENT_SHADER, fragmentSource);
+        shader->bindDefaults();
+        shader->linkProgram();
+
+        if (!shader->isLoaded()){
+            ofLogWarning() << "RenderGraph::compile() Couldn't build the shader for colour passes:\n" << fragmentSource << endl;
+        }
+
+        colorShaders[fragmentSource] = shader;
+        return shader;
+    }
+
+    shared_ptr<FboPool> fboPool;
+    vector<TargetInfo> targets;
+    vector<Pass> passes;
+    map<string, shared_ptr<ofShader>> colorShaders;
+    bool isCompiled = false;
+    int numExecutedPasses = 0;
+    int numFusedPasses = 0;
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "ofMain.h"
+#include <spawn.h>
+#include <sys/wait.h>
+#include <climits>
+#ifdef TARGET_OSX
+#include <mach-o/dyld.h>
+#endif
+
+extern char ** environ;
+
+// Splits an export's frames into contiguous ranges and renders each in a process of its
+// own, so that an offline render uses every core rather than the one the GL thread runs
+// on. Workers are this executable again (see getExecutablePath()), given the export's arguments plus --start and
+// --frames for their range. As frames are named by their number in the whole export and
+// every worker writes to the same directory, the ranges make up one sequence; once all
+// workers have exited the launcher checks that no frame is missing.
+// Each worker gets to its first frame by simulating the frames before it without drawing
+// them, which costs a fraction of rendering them.
+class RenderLauncher {
+public:
+    struct Range {
+        uint64_t startFrame = 0;
+        uint64_t numFrames = 0;
+    };
+
+    // Near equal ranges, the first ones a frame longer when they don't divide evenly. None
+    // for no frames.
+    static vector<Range> split(uint64_t startFrame, uint64_t numFrames, size_t numWorkers){
+        vector<Range> ranges;
+        numWorkers = min<uint64_t>(max<size_t>(numWorkers, 1), numFrames);
+
+        for (size_t i=0; i<numWorkers; i++){
+            Range range;
+            range.numFrames = numFrames / numWorkers + (i < numFrames % numWorkers ? 1 : 0);
+            range.startFrame = ranges.empty() ? startFrame : ranges.back().startFrame + ranges.back().numFrames;
+            ranges.push_back(range);
+        }
+
+        return ranges;
+    }
+
+    // arguments are the export's, without a range. Returns a process exit code.
+    int run(const string & executable, const vector<string> & arguments, uint64_t startFrame, uint64_t numFrames, size_t numWorkers){
+        if (numFrames == 0){
+            ofLogError() << "RenderLauncher No frames to render" << endl;
+            return 1;
+        }
+
+        vector<Range> ranges = split(startFrame, numFrames, numWorkers);
+        vector<pid_t> workers;
+        uint64_t startTime = ofGetElapsedTimeMillis();
+
+        for (auto & range : ranges){
+            vector<string> workerArguments = arguments;
+            workerArguments.insert(workerArguments.end(), {
+                "--start", ofToString(range.startFrame),
+                "--frames", ofToString(range.numFrames)
+            });
+
+            pid_t worker;
+            if (spawn(executable, workerArguments, worker)){
+                workers.push_back(worker);
+                ofLogNotice() << "RenderLauncher Rendering frames " << range.startFrame << " to " << range.startFrame + range.numFrames - 1 << " in process " << worker << endl;
+            }else{
+                ofLogError() << "RenderLauncher Couldn't start a worker for frames " << range.startFrame << " to " << range.startFrame + range.numFrames - 1 << endl;
+            }
+        }
+
+        int numFailed = ranges.size() - workers.size();
+
+        for (pid_t worker : workers){
+            int status = 0;
+            if (waitpid(worker, &status, 0) != worker || !WIFEXITED(status) || WEXITSTATUS(status) != 0){
+                ofLogError() << "RenderLauncher Worker " << worker << " failed" << endl;
+                numFailed++;
+            }
+        }
+
+        ofLogNotice() << "RenderLauncher Rendered " << numFrames << " frames on " << ranges.size() << " processes in "
+        << (ofGetElapsedTimeMillis() - startTime) / 1000.f << " s" << endl;
+
+        return numFailed == 0 ? 0 : 1;
+    }
+
+    // The path of the running executable, for starting workers from whatever directory
+    // the launcher runs in, or fallback (e.g. argv[0]) where that can't be found out.
+    static string getExecutablePath(const string & fallback){
+#if defined(TARGET_LINUX)
+        char path[PATH_MAX];
+        ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+        if (length > 0){
+            return string(path, length);
+        }
+#elif defined(TARGET_OSX)
+        char path[PATH_MAX];
+        uint32_t size = sizeof(path);
+        if (_NSGetExecutablePath(path, &size) == 0){
+            return path;
+        }
+#endif
+        return fallback;
+    }
+
+    // The frames of [startFrame, startFrame + numFrames) with no file in directory, which
+    // is relative to the data folder unless absolute.
+    static vector<uint64_t> findMissingFrames(const string & directory, const string & extension, uint64_t startFrame, uint64_t numFrames){
+        vector<uint64_t> missingFrames;
+        string path = ofToDataPath(directory, true);
+
+        for (uint64_t frame=startFrame; frame<startFrame + numFrames; frame++){
+            if (!ofFile::doesFileExist(path + "/frame_" + ofToString(frame, 6, '0') + "." + extension, false)){
+                missingFrames.push_back(frame);
+            }
+        }
+
+        return missingFrames;
+    }
+
+protected:
+    // Searches PATH for an executable without a directory, like a shell would for argv[0].
+    bool spawn(const string & executable, const vector<string> & arguments, pid_t & process){
+        vector<char *> argv;
+        argv.push_back(const_cast<char *>(executable.c_str()));
+        for (auto & argument : arguments){
+            argv.push_back(const_cast<char *>(argument.c_str()));
+        }
+        argv.push_back(nullptr);
+
+        return posix_spawnp(&process, executable.c_str(), nullptr, nullptr, argv.data(), environ) == 0;
+    }
+};
@@ -8,11 +8,12 @@
 
 #include "Shadows.h"
 
-void Shadows::setup(shared_ptr<Agents> agents, float desiredCamDistance){
+void Shadows::setup(shared_ptr<Agents> agents, float desiredCamDistance, shared_ptr<FboPool> fboPool){
     this->agents = agents;
     
     shadowsShader.load("shaders_gl3/floorShadows");
-    shadowBlur.setup(shadowWidth*shadowResolutionFactor, shadowHeight*shadowResolutionFactor);
+    // The blur's buffers come from the render graph.
+    shadowBlur.setup();
     shadowBlur.setBlurStrength(1.f);
     shadowCam.setPosition(0.f, -desiredCamDistance, 0.f);
     shadowCam.setOrientation({90.f, 0.f, 0.f});
@@ -20,7 +21,10 @@ void Shadows::setup(shared_ptr<Agents> agents, float desiredCamDistance){
     shadowPlane.setPosition(shadowPosition);
     shadowPlane.setOrientation(shadowOrientation);
     shadowPlane.mapTexCoords(0, 0, shadowWidth*shadowResolutionFactor, shadowHeight*shadowResolutionFactor);
-    fbo.allocate(shadowWidth, shadowHeight, GL_RGBA);
+    renderGraph.setFboPool(fboPool != nullptr ? fboPool : make_shared<FboPool>());
+    
+    splatShadowMap.setup(shadowWidth, shadowHeight, shadowWidth / SplatCellSize, shadowHeight / SplatCellSize);
+    splatShadowMap.setBlurRadius(SplatCellSize * 6.f);
 }
 
 void Shadows::draw(float alpha){
@@ -29,22 +33,181 @@ void Shadows::draw(float alpha){
         return;
     }
     
-    // Render agents into fbo.
-    fbo.begin();
-    ofClear(255.f, 0.f);
-    shadowBlur.begin();
-    shadowCam.begin();
-    shadowsShader.begin();
-    shadowsShader.setUniform1f("alpha", alpha);
-    agents->drawUntextured(ProportionOfAgentsInShadow);
-    shadowsShader.end();
-    shadowCam.end();
-    shadowBlur.end();
-    shadowBlur.draw(0.f, 0.f);
-    fbo.end();
-    
-    // Draw shadow from shadow blur.
-    fbo.getTexture().bind();
+    uint64_t startTime = ofGetElapsedTimeMicros();
+    bool isRendering = isRenderDue();
+    
+    if (isRendering){
+        render();
+    }
+    
+    // Draw shadow from the shadow map. It was rendered at full alpha, so that alpha can
+    // change without a render; the agents used to be drawn with alpha blended over
+    // transparent, which squared it.
+    ofPushStyle();
+    ofSetColor(255.f, 255.f * alpha * alpha);
+    ofTexture & shadowTexture = getShadowTexture();
+    shadowTexture.bind();
     shadowPlane.draw();
-    fbo.getTexture().unbind();
-}
\ No newline at end of file
+    shadowTexture.unbind();
+    ofPopStyle();
+    
+    updateStats((ofGetElapsedTimeMicros() - startTime) / 1000.f, isRendering);
+}
+
+void Shadows::setBackend(Backend backend){
+    this->backend = backend;
+    invalidate();
+    
+    if (backend == Backend::CpuSplat){
+        shadowPlane.mapTexCoords(0, 0, shadowWidth / SplatCellSize, shadowHeight / SplatCellSize);
+    }else{
+        shadowPlane.mapTexCoords(0, 0, shadowWidth*shadowResolutionFactor, shadowHeight*shadowResolutionFactor);
+    }
+}
+
+void Shadows::setNumThreads(size_t numThreads){
+    workerPool.setup(numThreads);
+}
+
+void Shadows::setMotionThreshold(float distance){
+    motionThreshold = distance;
+}
+
+void Shadows::setMaxUpdateRate(float updatesPerSecond){
+    maxUpdateRate = updatesPerSecond;
+}
+
+void Shadows::setTemporalBlend(float weight){
+    temporalBlend = ofClamp(weight, .01f, 1.f);
+}
+
+void Shadows::invalidate(){
+    isShadowMapValid = false;
+}
+
+const Shadows::Stats & Shadows::getStats() const{
+    return stats;
+}
+
+bool Shadows::isRenderDue(){
+    if (!isShadowMapValid){
+        return true;
+    }
+    
+    if (maxUpdateRate > 0.f && FrameClock::getElapsedTimef() - lastRenderTime < 1.f / maxUpdateRate){
+        return false;
+    }
+    
+    return numSettlingRenders > 0 || hasMovedSinceRender();
+}
+
+bool Shadows::hasMovedSinceRender(){
+    const vector<ofVec3f> & positions = agents->getDrawnPositions();
+    if (!isShadowMapValid || positions.size() != renderedPositions.size()){
+        return true;
+    }
+    
+    float squaredThreshold = motionThreshold * motionThreshold;
+    // Only the agents the map was rendered from, which for CpuSplat is all of them.
+    size_t stride = backend == Backend::CpuSplat ? 1 : ProportionOfAgentsInShadow;
+    
+    for (size_t i=0; i<positions.size(); i+=stride){
+        if (positions[i].squareDistance(renderedPositions[i]) > squaredThreshold){
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+void Shadows::render(){
+    if (backend == Backend::CpuSplat){
+        renderSplat();
+    }else{
+        renderGpu();
+    }
+    
+    // A render without movement counts towards catching up; movement starts over.
+    if (hasMovedSinceRender()){
+        // Until what's left of older renders is below a step of 8 bits.
+        numSettlingRenders = temporalBlend < 1.f ? ceil(log(1.f / 255.f) / log(1.f - temporalBlend)) : 0;
+    }else if (numSettlingRenders > 0){
+        numSettlingRenders--;
+    }
+    
+    renderedPositions = agents->getDrawnPositions();
+    lastRenderTime = FrameClock::getElapsedTimef();
+    isShadowMapValid = true;
+}
+
+void Shadows::renderGpu(){
+    int width = shadowWidth*shadowResolutionFactor;
+    int height = shadowHeight*shadowResolutionFactor;
+    
+    if (!shadowMap.isAllocated()){
+        shadowMap.allocate(width, height, GL_RGBA);
+    }
+    
+    // The first render, or one replacing the map, is blurred straight into it.
+    bool isBlending = isShadowMapValid && temporalBlend < 1.f;
+    
+    renderGraph.clear();
+    RenderGraph::Target agentsTarget = renderGraph.createTarget("shadowAgents", width, height);
+    RenderGraph::Target shadowMapTarget = renderGraph.importTarget("shadowMap", shadowMap);
+    RenderGraph::Target blurredTarget = isBlending ? renderGraph.createTarget("shadowBlurred", width, height) : shadowMapTarget;
+    
+    // Render agents, on transparent white so that the blurred edges don't darken.
+    renderGraph.addPass("shadowAgents", {}, agentsTarget, [this]{
+        shadowCam.begin();
+        shadowsShader.begin();
+        shadowsShader.setUniform1f("alpha", 1.f);
+        agents->drawUntextured(ProportionOfAgentsInShadow);
+        shadowsShader.end();
+        shadowCam.end();
+    }, true, ofFloatColor(1.f, 0.f));
+    
+    shadowBlur.addPasses(renderGraph, agentsTarget, blurredTarget);
+    
+    if (isBlending){
+        // map = mix(map, blurred, temporalBlend), alpha included.
+        float weight = temporalBlend;
+        renderGraph.addPass("shadowBlend", {blurredTarget}, shadowMapTarget, [this, blurredTarget, weight, width, height]{
+            ofPushStyle();
+            ofEnableAlphaBlending();
+            glBlendColor(0.f, 0.f, 0.f, weight);
+            glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+            renderGraph.getTexture(blurredTarget).draw(0.f, 0.f, width, height);
+            ofPopStyle();
+        });
+    }
+    
+    renderGraph.compile();
+    renderGraph.execute();
+}
+
+void Shadows::renderSplat(){
+    float blend = isShadowMapValid ? temporalBlend : 1.f;
+    splatShadowMap.update(agents->getDrawnPositions(), blend, &workerPool);
+    splatTexture.loadData(splatShadowMap.getPixels());
+}
+
+ofTexture & Shadows::getShadowTexture(){
+    return backend == Backend::CpuSplat ? splatTexture : shadowMap.getTexture();
+}
+
+void Shadows::updateStats(float millis, bool isRendered){
+    const float Smoothing = .05f;
+    
+    stats.millisPerFrame += (millis - stats.millisPerFrame) * Smoothing;
+    if (isRendered){
+        stats.millisPerRender += (millis - stats.millisPerRender) * Smoothing;
+        numRendersThisSecond++;
+    }
+    
+    float now = ofGetElapsedTimef();
+    if (now - statsSecondStartTime >= 1.f){
+        stats.rendersPerSecond = numRendersThisSecond / (now - statsSecondStartTime);
+        numRendersThisSecond = 0;
+        statsSecondStartTime = now;
+    }
+}
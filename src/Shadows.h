@@ -13,13 +13,59 @@
 #include "Agents.h"
 #include "Blur.h"
 #include "Camera.h"
+#include "RenderGraph.h"
+#include "FrameClock.h"
+#include "SplatShadowMap.h"
+#include "WorkerPool.h"
 
+// Agents' shadows on the floor, rendered from below into a shadow map that is kept between
+// frames. The map is only rendered again when some shadow casting agent has moved further
+// than a threshold since the last time, at most at a maximum rate. A new render can be
+// blended into the map rather than replace it, which smooths the steps of a low rate; the
+// map keeps being rendered after agents stop until it has caught up.
+// Two backends render the map. Gpu draws every ProportionOfAgentsInShadow-th agent from
+// below through the blur. CpuSplat splats every agent's footprint into a SplatShadowMap
+// and uploads it as one texture, at a cost that doesn't depend on how agents are drawn.
 class Shadows {
 public:
-    void setup(shared_ptr<Agents> agents, float desiredCamDistance);
+    enum class Backend { Gpu, CpuSplat };
+    
+    // Times are CPU time spent in draw(), smoothed. That includes issuing the GL work but
+    // not the GPU's share, which goes with the rate of renders.
+    struct Stats {
+        float millisPerFrame = 0.f;
+        float millisPerRender = 0.f;
+        float rendersPerSecond = 0.f;
+    };
+    
+    // Offscreen targets come from fboPool, shared with other effects, or from a pool of the
+    // shadows' own if there is none.
+    void setup(shared_ptr<Agents> agents, float desiredCamDistance, shared_ptr<FboPool> fboPool = nullptr);
     void draw(float alpha);
     
+    void setBackend(Backend backend);
+    // For the CpuSplat backend's blur; 1 blurs on the calling thread.
+    void setNumThreads(size_t numThreads);
+    // 0 renders the map every frame.
+    void setMotionThreshold(float distance);
+    // 0 doesn't limit the rate.
+    void setMaxUpdateRate(float updatesPerSecond);
+    // How much of a new render goes into the map, 1 replacing it.
+    void setTemporalBlend(float weight);
+    // Renders the map on the next draw(), e.g. after agents were replaced.
+    void invalidate();
+    const Stats & getStats() const;
+    
 protected:
+    bool isRenderDue();
+    bool hasMovedSinceRender();
+    void render();
+    void renderGpu();
+    void renderSplat();
+    ofTexture & getShadowTexture();
+    void updateStats(float millis, bool isRendered);
+    
+
     ofVec3f shadowPosition = {0.f, -1500.f, 0.f};
     ofVec3f shadowOrientation = {90.f, 0.f, 0.f};
     float shadowWidth = 1600.f;
@@ -33,5 +79,26 @@ protected:
     Blur shadowBlur;
     ofPlanePrimitive shadowPlane;
     ofShader shadowsShader;
-    ofFbo fbo;
+    RenderGraph renderGraph;
+    
+    Backend backend = Backend::Gpu;
+    ofFbo shadowMap;
+    SplatShadowMap splatShadowMap;
+    ofTexture splatTexture;
+    WorkerPool workerPool;
+    // The CpuSplat grid's cell, in floor units.
+    const float SplatCellSize = 8.f;
+    bool isShadowMapValid = false;
+    // Where the shadow casting agents were at the last render.
+    vector<ofVec3f> renderedPositions;
+    float lastRenderTime = 0.f;
+    // Renders still needed for a blended map to catch up once agents stop.
+    int numSettlingRenders = 0;
+    float motionThreshold = 0.f;
+    float maxUpdateRate = 0.f;
+    float temporalBlend = 1.f;
+    
+    Stats stats;
+    int numRendersThisSecond = 0;
+    float statsSecondStartTime = 0.f;
 };
\ No newline at end of file
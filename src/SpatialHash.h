@@ -0,0 +1,118 @@
+#pragma once
+
+#include "ofMain.h"
+
+// Uniform grid over 3D space for finding the agents near a point. Cells are hashed into a
+// table about twice the size of the agent count, so the grid is unbounded and works the
+// same for agents on a sphere's surface as for agents on a plane. build() is a counting
+// sort by cell, O(n) with no allocation once the arrays have grown, and leaves each cell's
+// agents next to each other together with copies of their positions.
+class SpatialHash {
+public:
+    void build(const vector<ofVec3f> &positions, float cellSize){
+        this->cellSize = cellSize;
+        inverseCellSize = 1.f / cellSize;
+
+        size_t numAgents = positions.size();
+        size_t tableSize = 1;
+        while (tableSize < 2 * numAgents){
+            tableSize <<= 1;
+        }
+        tableMask = tableSize - 1;
+
+        cellStarts.assign(tableSize + 1, 0);
+        agentCells.resize(numAgents);
+
+        for (size_t i=0; i<numAgents; i++){
+            uint32_t cell = getCell(positions[i]);
+            agentCells[i] = cell;
+            cellStarts[cell + 1]++;
+        }
+
+        for (size_t cell=0; cell<tableSize; cell++){
+            cellStarts[cell + 1] += cellStarts[cell];
+        }
+
+        cellCursors.assign(cellStarts.begin(), cellStarts.end() - 1);
+        sortedIndices.resize(numAgents);
+        sortedPositions.resize(numAgents);
+
+        for (size_t i=0; i<numAgents; i++){
+            uint32_t slot = cellCursors[agentCells[i]]++;
+            sortedIndices[slot] = i;
+            sortedPositions[slot] = positions[i];
+        }
+    }
+
+    // Calls function(index, position, distanceSquared) for every agent within radius of
+    // position, as of the last build(), including an agent at position itself. The order is
+    // fixed by the positions, and function can return false to stop the query early.
+    template <class Function>
+    void forEachNeighbour(ofVec3f position, float radius, Function function) const{
+        if (sortedIndices.empty()){
+            return;
+        }
+
+        int minX = floor((position.x - radius) * inverseCellSize);
+        int minY = floor((position.y - radius) * inverseCellSize);
+        int minZ = floor((position.z - radius) * inverseCellSize);
+        int maxX = floor((position.x + radius) * inverseCellSize);
+        int maxY = floor((position.y + radius) * inverseCellSize);
+        int maxZ = floor((position.z + radius) * inverseCellSize);
+        float radiusSquared = radius * radius;
+
+        // Different cells can hash to the same table entry; visit each entry once. Queries
+        // with a radius over the cell size can span more cells than are remembered here,
+        // in which case an entry may be visited twice.
+        uint32_t visited[MaxRememberedCells];
+        size_t numVisited = 0;
+
+        for (int z=minZ; z<=maxZ; z++){
+            for (int y=minY; y<=maxY; y++){
+                for (int x=minX; x<=maxX; x++){
+                    uint32_t cell = hashCell(x, y, z);
+
+                    if (find(visited, visited + numVisited, cell) != visited + numVisited){
+                        continue;
+                    }
+                    if (numVisited < MaxRememberedCells){
+                        visited[numVisited++] = cell;
+                    }
+
+                    for (uint32_t slot=cellStarts[cell]; slot<cellStarts[cell + 1]; slot++){
+                        float distanceSquared = position.squareDistance(sortedPositions[slot]);
+
+                        if (distanceSquared <= radiusSquared && !function(sortedIndices[slot], sortedPositions[slot], distanceSquared)){
+                            return;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    float getCellSize() const{
+        return cellSize;
+    }
+
+protected:
+    const static size_t MaxRememberedCells = 27;
+
+    uint32_t getCell(ofVec3f position) const{
+        return hashCell(floor(position.x * inverseCellSize), floor(position.y * inverseCellSize), floor(position.z * inverseCellSize));
+    }
+
+    uint32_t hashCell(int x, int y, int z) const{
+        return (uint32_t(x) * 73856093u ^ uint32_t(y) * 19349663u ^ uint32_t(z) * 83492791u) & tableMask;
+    }
+
+    float cellSize = 1.f;
+    float inverseCellSize = 1.f;
+    uint32_t tableMask = 0;
+
+    vector<uint32_t> cellStarts;
+    vector<uint32_t> cellCursors;
+    vector<uint32_t> agentCells;
+    vector<uint32_t> sortedIndices;
+    vector<ofVec3f> sortedPositions;
+};
@@ -0,0 +1,223 @@
+#pragma once
+
+#include "ofMain.h"
+#include "Simd.h"
+#include "WorkerPool.h"
+
+// Soft shadows of points cast straight down onto the floor, worked out on the CPU. Each
+// point adds its weight bilinearly to the four cells of a float density grid around its
+// (x, z), then the grid is blurred with two separable box filters, which together come
+// close to a Gaussian, and mapped to coverage. The cost depends only on the number of
+// points and the grid size, not on how the points are drawn.
+// Rows of the grid run along x from -width / 2; row 0 is at z = depth / 2, matching the
+// texture coordinates of an ofPlanePrimitive turned 90 degrees about x to lie on the floor.
+class SplatShadowMap {
+public:
+    // The floor area covered, centred on the origin, and the grid's resolution.
+    void setup(float width, float depth, int numColumns, int numRows){
+        this->width = width;
+        this->depth = depth;
+        this->numColumns = numColumns;
+        this->numRows = numRows;
+        stride = (numColumns + Float8::Width - 1) / Float8::Width * Float8::Width;
+
+        density.assign(stride * numRows, 0.f);
+        scratch.assign(stride * numRows, 0.f);
+        coverage.assign(stride * numRows, 0.f);
+        pixels.allocate(numColumns, numRows, OF_PIXELS_RGBA);
+        pixels.set(0);
+    }
+
+    // How far, in floor units, a point's shadow spreads from it.
+    void setBlurRadius(float distance){
+        blurRadius = distance;
+    }
+
+    // The coverage of a lone point's shadow at its centre, before clamping to 1.
+    void setDarkness(float darkness){
+        this->darkness = darkness;
+    }
+
+    // Splats the points and blurs them. blend is how much of the result goes into the
+    // coverage, 1 replacing the last. Pass a pool to blur in parallel.
+    void update(const vector<ofVec3f> & positions, float blend = 1.f, WorkerPool * pool = nullptr){
+        if (density.empty()){
+            return;
+        }
+
+        splat(positions);
+
+        int radiusX = ofClamp(round(blurRadius / 2.f / width * numColumns), 0, numColumns);
+        int radiusZ = ofClamp(round(blurRadius / 2.f / depth * numRows), 0, numRows);
+
+        blurRows(density, scratch, radiusX, pool);
+        blurRows(scratch, density, radiusX, pool);
+        blurColumns(density, scratch, radiusZ, pool);
+        blurColumns(scratch, density, radiusZ, pool);
+
+        // Two box filters of width n make a tent peaking at 1 / n, so a lone point peaks
+        // at 1 / (nx * nz) before the scale.
+        float scale = darkness * (2 * radiusX + 1) * (2 * radiusZ + 1);
+        updateCoverage(scale, blend, pool);
+    }
+
+    // Black, with the coverage as alpha, for uploading to a texture.
+    const ofPixels & getPixels() const{
+        return pixels;
+    }
+
+protected:
+    const size_t RowsPerChunk = 16;
+
+    void splat(const vector<ofVec3f> & positions){
+        fill(density.begin(), density.end(), 0.f);
+
+        // Grid coordinates, eight points at a time, with cell centres on whole numbers.
+        size_t paddedCount = (positions.size() + Float8::Width - 1) / Float8::Width * Float8::Width;
+        columns.resize(paddedCount);
+        rows.resize(paddedCount);
+        xs.assign(paddedCount, 0.f);
+        zs.assign(paddedCount, 0.f);
+
+        for (size_t i=0; i<positions.size(); i++){
+            xs[i] = positions[i].x;
+            zs[i] = positions[i].z;
+        }
+
+        Float8 columnScale = Float8::broadcast(numColumns / width);
+        Float8 columnOffset = Float8::broadcast(numColumns * .5f - .5f);
+        Float8 rowScale = Float8::broadcast(-numRows / depth);
+        Float8 rowOffset = Float8::broadcast(numRows * .5f - .5f);
+
+        for (size_t i=0; i<paddedCount; i+=Float8::Width){
+            (Float8::load(&xs[i]) * columnScale + columnOffset).store(&columns[i]);
+            (Float8::load(&zs[i]) * rowScale + rowOffset).store(&rows[i]);
+        }
+
+        for (size_t i=0; i<positions.size(); i++){
+            float column = columns[i];
+            float row = rows[i];
+
+            if (column < -1.f || row < -1.f || column >= numColumns || row >= numRows){
+                continue;
+            }
+
+            int column0 = floor(column);
+            int row0 = floor(row);
+            float fx = column - column0;
+            float fz = row - row0;
+
+            addToCell(column0, row0, (1.f - fx) * (1.f - fz));
+            addToCell(column0 + 1, row0, fx * (1.f - fz));
+            addToCell(column0, row0 + 1, (1.f - fx) * fz);
+            addToCell(column0 + 1, row0 + 1, fx * fz);
+        }
+    }
+
+    void addToCell(int column, int row, float weight){
+        if (column >= 0 && row >= 0 && column < numColumns && row < numRows){
+            density[row * stride + column] += weight;
+        }
+    }
+
+    // Box filter along x, zero beyond the edges, with a running sum per row.
+    void blurRows(const vector<float> & source, vector<float> & destination, int radius, WorkerPool * pool){
+        float normalisation = 1.f / (2 * radius + 1);
+
+        forEachChunk(numRows, RowsPerChunk, pool, [&](size_t begin, size_t end){
+            for (size_t row=begin; row<end; row++){
+                const float * in = &source[row * stride];
+                float * out = &destination[row * stride];
+                float sum = 0.f;
+
+                for (int column=0; column<=radius && column<numColumns; column++){
+                    sum += in[column];
+                }
+
+                for (int column=0; column<numColumns; column++){
+                    out[column] = sum * normalisation;
+
+                    if (column + radius + 1 < numColumns){
+                        sum += in[column + radius + 1];
+                    }
+                    if (column - radius >= 0){
+                        sum -= in[column - radius];
+                    }
+                }
+            }
+        });
+    }
+
+    // Box filter along z, eight columns at a time.
+    void blurColumns(const vector<float> & source, vector<float> & destination, int radius, WorkerPool * pool){
+        Float8 normalisation = Float8::broadcast(1.f / (2 * radius + 1));
+        size_t numBlocks = stride / Float8::Width;
+
+        forEachChunk(numBlocks, 1, pool, [&](size_t begin, size_t end){
+            for (size_t block=begin; block<end; block++){
+                const float * in = &source[block * Float8::Width];
+                float * out = &destination[block * Float8::Width];
+                Float8 sum = Float8::broadcast(0.f);
+
+                for (int row=0; row<=radius && row<numRows; row++){
+                    sum = sum + Float8::load(in + row * stride);
+                }
+
+                for (int row=0; row<numRows; row++){
+                    (sum * normalisation).store(out + row * stride);
+
+                    if (row + radius + 1 < numRows){
+                        sum = sum + Float8::load(in + (row + radius + 1) * stride);
+                    }
+                    if (row - radius >= 0){
+                        sum = sum - Float8::load(in + (row - radius) * stride);
+                    }
+                }
+            }
+        });
+    }
+
+    void updateCoverage(float scale, float blend, WorkerPool * pool){
+        Float8 scale8 = Float8::broadcast(scale);
+        Float8 one = Float8::broadcast(1.f);
+        Float8 blend8 = Float8::broadcast(ofClamp(blend, 0.f, 1.f));
+        unsigned char * data = pixels.getData();
+
+        forEachChunk(numRows, RowsPerChunk, pool, [&](size_t begin, size_t end){
+            for (size_t row=begin; row<end; row++){
+                for (size_t column=0; column<stride; column+=Float8::Width){
+                    size_t i = row * stride + column;
+                    Float8 fresh = Float8::min(Float8::load(&density[i]) * scale8, one);
+                    Float8 last = Float8::load(&coverage[i]);
+                    (last + (fresh - last) * blend8).store(&coverage[i]);
+                }
+
+                for (int column=0; column<numColumns; column++){
+                    data[(row * numColumns + column) * 4 + 3] = coverage[row * stride + column] * 255.f + .5f;
+                }
+            }
+        });
+    }
+
+    template<class Function>
+    void forEachChunk(size_t count, size_t grainSize, WorkerPool * pool, Function function){
+        if (pool != nullptr){
+            pool->parallelFor(count, grainSize, function);
+        }else{
+            function(0, count);
+        }
+    }
+
+    float width = 1.f;
+    float depth = 1.f;
+    int numColumns = 0;
+    int numRows = 0;
+    // Row length of the grids, padded to a multiple of Float8::Width.
+    size_t stride = 0;
+    float blurRadius = 40.f;
+    float darkness = .5f;
+
+    vector<float> density, scratch, coverage;
+    vector<float> xs, zs, columns, rows;
+    ofPixels pixels;
+};
@@ -1,11 +1,14 @@
 #pragma once
 #include "Animator.h"
 #include "Poster.h"
+#include "GlyphCache.h"
 
 // A single text item, including its font.
 class Text {
 public:
-    void setup(string text, string fontName, int fontSize, string dropShadowFilename, ofVec2f dropShadowScaling){
+    // Looks the letters up in glyphCache, tessellating any glyphs it doesn't have yet, so
+    // that getLetters() costs nothing when a transition starts.
+    void setup(string text, string fontName, int fontSize, string dropShadowFilename, ofVec2f dropShadowScaling, GlyphCache &glyphCache){
         this->text = text;
         this->font.load(fontName, fontSize, true, false, true);
         calculateDrawPosition();
@@ -13,6 +16,7 @@ public:
         auto bb = getBoundingBox();
         this->dropShadowSize.x = bb.getWidth() * dropShadowScaling.x;
         this->dropShadowSize.y = bb.getHeight() * dropShadowScaling.y;
+        this->letters = glyphCache.getLetters(font, fontName, fontSize, text);
     }
     
     ofVec2f getDrawPosition() const{
@@ -31,6 +35,11 @@ public:
         return font.getStringAsPoints(text, false);
     }
     
+    // The same letters as getLetterPaths(), already tessellated.
+    const vector<GlyphCache::Letter> & getLetters() const{
+        return letters;
+    }
+    
     string getText() const{
         return text;
     }
@@ -62,6 +71,7 @@ protected:
     ofVec2f textDrawPosition;
     string dropShadowFilename;
     ofVec2f dropShadowSize;
+    vector<GlyphCache::Letter> letters;
 };
 
 // A class to manage all text items.
@@ -71,9 +81,10 @@ public:
         animator.setup(0.f, MaximumAlpha, DefaultAnimationDuration);
     }
     
+    // Tessellates the text's letters here, at setup, rather than when it is shown.
     void addText(string text, string fontName, int fontSize, string dropShadowFilename, ofVec2f dropShadowScaling){
         unique_ptr<Text> textItem = make_unique<Text>();
-        textItem->setup(text, fontName, fontSize, dropShadowFilename, dropShadowScaling);
+        textItem->setup(text, fontName, fontSize, dropShadowFilename, dropShadowScaling, glyphCache);
         texts.emplace_back(move(textItem));
         textIt = this->texts.cend();
     }
@@ -122,6 +133,14 @@ public:
         return paths;
     }
     
+    const vector<GlyphCache::Letter> & getLetters(){
+        return (*textIt)->getLetters();
+    }
+    
+    GlyphCache & getGlyphCache(){
+        return glyphCache;
+    }
+    
     ofVec2f getDrawPosition(){
         return (*textIt)->getDrawPosition();
     }
@@ -142,6 +161,8 @@ protected:
     const float MaximumAlpha = 255;
     const float DefaultAnimationDuration = .1f;
     
+    // Shared by the texts, so that the glyphs they have in common are tessellated once.
+    GlyphCache glyphCache;
     vector< unique_ptr<Text> > texts;
     vector< unique_ptr<Text> >::const_iterator textIt;
     Animator animator;
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+
+// Lock-free handoff of snapshots from one writer thread to one reader thread. The writer
+// fills the back buffer and publishes it; the reader picks up the newest published buffer
+// whenever it likes. Neither side ever waits for the other and the reader never sees a
+// buffer that is being written. Buffers are reused, so once their contents have grown to
+// size no allocation happens.
+template <class T>
+class TripleBuffer {
+public:
+    // Writer side.
+    T & getBack(){
+        return buffers[back];
+    }
+
+    void publish(){
+        back = middle.exchange(back | FreshBit) & IndexMask;
+    }
+
+    // Reader side. Returns true if a newer buffer was published since the last call.
+    bool updateFront(){
+        if ((middle.load() & FreshBit) == 0){
+            return false;
+        }
+
+        front = middle.exchange(front) & IndexMask;
+        return true;
+    }
+
+    const T & getFront() const{
+        return buffers[front];
+    }
+
+protected:
+    const static int FreshBit = 4;
+    const static int IndexMask = 3;
+
+    T buffers[3];
+    int back = 0;
+    int front = 1;
+    std::atomic<int> middle {2};
+};
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "ofMain.h"
+#include "ParticleSystem.h"
+#include "MorphStore.h"
+#include "InstancedSpriteRenderer.h"
 
 class Visualisation {
 public:
@@ -9,6 +12,33 @@ public:
     };
     virtual void bringItHome(float durationSeconds) {
     };
+    // Called with the agent's position from each new frame, before it is drawn, for
+    // visualisations with state of their own that follows the agent.
+    virtual void update(ofVec3f position) {
+    };
+    
+    // Visualisations that only draw geometry with a single texture can return it here, so
+    // that consecutive ones using the same texture are drawn with drawWithBoundTexture()
+    // under one bind.
+    virtual const ofTexture * getSharedTexture() const{
+        return nullptr;
+    }
+    
+    virtual void drawWithBoundTexture(ofVec3f position, ofVec3f orientationEuler){
+        draw(position, orientationEuler);
+    }
+    
+    // Visualisations that InstancedSpriteRenderer can draw fill in everything but the
+    // instance's position and orientation and return true. They must have a shared texture.
+    virtual bool getSpriteInstance(SpriteInstance & instance) const{
+        return false;
+    }
+    
+    // The radius around the agent's position that everything drawn stays within, for
+    // culling. Visualisations that can't tell are never culled.
+    virtual float getBoundingRadius() const{
+        return numeric_limits<float>::max();
+    }
 };
 
 class SphereVisualisation : public Visualisation {
@@ -25,23 +55,29 @@ public:
         ofPopStyle();
     }
     
+    virtual float getBoundingRadius() const override{
+        return sphere.getRadius();
+    }
+    
 protected:
     ofSpherePrimitive sphere;
 };
 
+// A textured plane. The texture can be shared between sprites (e.g. an atlas), with the
+// plane's texture coordinates picking out each sprite's part. color is a colour from the
+// sprite's image for visualisations that need one.
 class SpriteVisualisation : public Visualisation {
 public:
-    virtual void setup(ofPlanePrimitive plane, ofImage texture){
+    virtual void setup(ofPlanePrimitive plane, shared_ptr<ofTexture> texture, ofColor color){
         this->plane = plane;
         this->texture = texture;
+        this->color = color;
     }
 
     virtual void draw(ofVec3f position, ofVec3f orientationEuler) override{
-        plane.setPosition(position);
-        plane.setOrientation(orientationEuler);
-        texture.getTexture().bind();
-        plane.draw();
-        texture.getTexture().unbind();
+        texture->bind();
+        drawWithBoundTexture(position, orientationEuler);
+        texture->unbind();
     }
     
     virtual void drawUntextured(ofVec3f position, ofVec3f orientationEuler) override{
@@ -49,120 +85,180 @@ public:
         plane.setOrientation(orientationEuler);
         plane.draw();
     }
+    
+    virtual const ofTexture * getSharedTexture() const override{
+        return texture.get();
+    }
+    
+    virtual void drawWithBoundTexture(ofVec3f position, ofVec3f orientationEuler) override{
+        drawUntextured(position, orientationEuler);
+    }
+    
+    virtual bool getSpriteInstance(SpriteInstance & instance) const override{
+        instance.crumpleSeed = 0.f;
+        instance.texCoordRect = plane.getTexCoords();
+        instance.size = ofVec2f(plane.getWidth(), plane.getHeight());
+        instance.homeness = 1.f;
+        return true;
+    }
+    
+    virtual float getBoundingRadius() const override{
+        return .5f * ofVec2f(plane.getWidth(), plane.getHeight()).length();
+    }
 
 protected:
-    ofImage texture;
+    shared_ptr<ofTexture> texture;
     ofPlanePrimitive plane;
+    ofColor color;
 };
 
 class TornPaperVisualisation : public SpriteVisualisation {
 public:
-    virtual void setup(ofPlanePrimitive plane, ofImage texture) override{
-        SpriteVisualisation::setup(plane, texture);
+    virtual void setup(ofPlanePrimitive plane, shared_ptr<ofTexture> texture, ofColor color) override{
+        SpriteVisualisation::setup(plane, texture, color);
         
         ofMesh & mesh = this->plane.getMesh();
         float maxDisplacement = plane.getWidth();
+        // The crumple comes from the seed so that InstancedSpriteRenderer can recreate it.
+        crumpleSeed = SpriteInstance::getRandomCrumpleSeed();
 
         for (size_t i=0; i<mesh.getNumVertices(); i++){
-            ofVec3f displacement(ofRandom(maxDisplacement), ofRandom(maxDisplacement), ofRandom(maxDisplacement));
             ofVec3f vertex = mesh.getVertex(i);
-            vertex += displacement;
+            ofVec2f latticePoint = SpriteInstance::getCrumpleLatticePoint(vertex, plane.getWidth(), plane.getHeight());
+            vertex += SpriteInstance::getCrumpleDisplacement(crumpleSeed, latticePoint, maxDisplacement);
 
             mesh.setVertex(i, vertex);
         }
     }
+    
+    virtual bool getSpriteInstance(SpriteInstance & instance) const override{
+        SpriteVisualisation::getSpriteInstance(instance);
+        instance.crumpleSeed = crumpleSeed;
+        instance.homeness = 0.f;
+        return true;
+    }
+    
+    virtual float getBoundingRadius() const override{
+        return SpriteVisualisation::getBoundingRadius() + getMaxCrumpleDistance();
+    }
+    
+protected:
+    // How far the crumple can move a vertex, see SpriteInstance::getCrumpleDisplacement().
+    float getMaxCrumpleDistance() const{
+        return plane.getWidth() * sqrt(3.f);
+    }
+    
+    uint32_t crumpleSeed = 0;
 };
 
+// Torn paper with particles drifting up from it. The particles belong to a ParticleSystem
+// shared by the scene, which updates and draws all of them; the visualisation is their
+// emitter and tells the system where it is in update(). The paper itself is drawn like
+// any other torn paper.
 class TornPaperWithParticlesVisualisation : public TornPaperVisualisation {
 public:
-    virtual void setup(ofPlanePrimitive plane, ofImage texture) override{
-        TornPaperVisualisation::setup(plane, texture);
-        
-        color = texture.getColor(0, 0);
-        
-        for (int i=0; i<1; i++){
-            ofSpherePrimitive particle;
-            particle.setRadius(1);
-            // Random positions for all particles within a bounding rect.
-            particlesRelativePositions.push_back(ofVec3f(ofRandom(-10, 10), ofRandom(-200, 10), 0));
-            
-            particles.push_back(particle);
-        }
+    // Must be called before setup().
+    void setParticleSystem(shared_ptr<ParticleSystem> particleSystem, size_t numParticles){
+        this->particleSystem = particleSystem;
+        this->numParticles = numParticles;
     }
     
-    virtual void draw(ofVec3f position, ofVec3f orientationEuler) override{
-        TornPaperVisualisation::draw(position, orientationEuler);
+    virtual void setup(ofPlanePrimitive plane, shared_ptr<ofTexture> texture, ofColor color) override{
+        TornPaperVisualisation::setup(plane, texture, color);
         
-        if (plane.getPosition().y > ofGetHeight()/2){
+        if (particleSystem == nullptr){
+            ofLogWarning() << "TornPaperWithParticlesVisualisation::setup() Has no particles as setParticleSystem() hasn't been called" << endl;
             return;
         }
         
-        float noiseScale = ofMap(ofGetMouseX(), 0, ofGetWidth(), 0, 1.f);
-        float noiseVel = ofGetElapsedTimef();
-
-        for (int i=0; i<particles.size(); i++){
-            float noiseValue1 = ofNoise(i * noiseScale, 200 * noiseScale, noiseVel) - .5f;
-            float noiseValue2 = ofNoise(i * noiseScale, 1200 * noiseScale, noiseVel);
-            
-            particlesRelativePositions[i] += ofVec3f(noiseValue1, 1.f + noiseValue2, 0);
-            
-            if (particlesRelativePositions[i].y > upperLimit){
-                particlesRelativePositions[i] = ofVec3f(ofRandom(-10, 10), ofRandom(-10, 10), 0);
-            }
-
-            ofPushStyle();
-            ofSetColor(color, ofMap(particlesRelativePositions[i].y, upperLimit, 0, 0, 255));
-            if (particlesRelativePositions[i].y < 0){
-                ofSetColor(color, 0);
-            }
-            particles[i].setPosition(plane.getPosition() + particlesRelativePositions[i]);
-            particles[i].draw();
-            ofPopStyle();
+        emitterIndex = particleSystem->addEmitter(color, numParticles);
+    }
+    
+    virtual void update(ofVec3f position) override{
+        if (particleSystem != nullptr){
+            particleSystem->setEmitterPosition(emitterIndex, position, position.y <= ofGetHeight()/2);
         }
     }
     
+    virtual float getBoundingRadius() const override{
+        return TornPaperVisualisation::getBoundingRadius() + (particleSystem != nullptr ? particleSystem->getReach() : 0.f);
+    }
+    
 protected:
-    vector<ofVec3f> particlesRelativePositions;
-    vector<ofSpherePrimitive> particles;
-    ofColor color;
-    float upperLimit = 100;
+    shared_ptr<ParticleSystem> particleSystem;
+    size_t numParticles = 0;
+    size_t emitterIndex = 0;
 };
 
 // A visualisation that is like crumpled paper in its normal state but
 // can uncrumple back to flat paper on command.
+// The flat and crumpled vertex positions live in a MorphStore, which can be shared by all
+// the sprites of a scene so that uncrumpling them is one pass over one array. Sprites
+// without a store get one of their own.
 class UncrumplingPaperVisualisation : public TornPaperVisualisation {
 public:
-    virtual void setup(ofPlanePrimitive plane, ofImage texture) override{
-        // Cache the original flat mesh.
-        ofMesh & mesh = plane.getMesh();
-        flatMesh = mesh;
-        
-        for (size_t i=0; i<mesh.getNumVertices(); i++){
-            flatMesh.setVertex(i, mesh.getVertex(i));
-        }
+    // Must be called before setup().
+    void setMorphStore(shared_ptr<MorphStore> morphStore){
+        this->morphStore = morphStore;
+    }
+    
+    virtual void setup(ofPlanePrimitive plane, shared_ptr<ofTexture> texture, ofColor color) override{
+        vector<ofVec3f> flatVertices = plane.getMesh().getVertices();
         
         // Let TornPaperVisualisation do the crumpling.
-        TornPaperVisualisation::setup(plane, texture);
+        TornPaperVisualisation::setup(plane, texture, color);
         
-        // Cache the crumpled mesh.
-        mesh = this->plane.getMesh();
-        crumpledMesh = mesh;
-
-        for (size_t i=0; i<mesh.getNumVertices(); i++){
-            crumpledMesh.setVertex(i, mesh.getVertex(i));
+        if (morphStore == nullptr){
+            morphStore = make_shared<MorphStore>();
         }
+        
+        morphSlot = morphStore->add(flatVertices, this->plane.getMesh().getVertices());
+        morphVersion = morphStore->getVersion(morphSlot);
     }
     
     virtual void bringItHome(float normalisedHomeness) override{
-        ofMesh & mesh = plane.getMesh();
+        homeness = normalisedHomeness;
+        morphStore->setHomeness(morphSlot, normalisedHomeness);
+    }
+    
+    virtual bool getSpriteInstance(SpriteInstance & instance) const override{
+        TornPaperVisualisation::getSpriteInstance(instance);
+        instance.homeness = homeness;
+        return true;
+    }
+    
+    virtual float getBoundingRadius() const override{
+        return SpriteVisualisation::getBoundingRadius() + getMaxCrumpleDistance() * (1.f - homeness);
+    }
+    
+    virtual void drawUntextured(ofVec3f position, ofVec3f orientationEuler) override{
+        updateMesh();
+        TornPaperVisualisation::drawUntextured(position, orientationEuler);
+    }
+    
+protected:
+    // Brings the plane's mesh up to date with the store, after updating the store if any of
+    // its sprites' homeness changed.
+    void updateMesh(){
+        morphStore->update();
         
-        for (int i=0; i<mesh.getNumVertices(); i++){
-            ofVec3f vertex = flatMesh.getVertex(i) - crumpledMesh.getVertex(i);
-
-            mesh.setVertex(i, crumpledMesh.getVertex(i) + vertex*normalisedHomeness);
+        if (morphStore->getVersion(morphSlot) == morphVersion){
+            return;
+        }
+        
+        vector<ofVec3f> & vertices = plane.getMesh().getVertices();
+        const float * positions = morphStore->getPositions(morphSlot);
+        size_t numVertices = min(vertices.size(), morphStore->getNumVertices());
+        
+        for (size_t i=0; i<numVertices; i++){
+            vertices[i].set(positions[i*3], positions[i*3 + 1], positions[i*3 + 2]);
         }
+        
+        morphVersion = morphStore->getVersion(morphSlot);
     }
     
-protected:
-    ofMesh flatMesh, crumpledMesh;
+    float homeness = 0.f;
+    shared_ptr<MorphStore> morphStore;
+    size_t morphSlot = 0;
+    unsigned int morphVersion = 0;
 };
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Visualisation.h"
+#include "WorkerPool.h"
 
 class VisualisationSource {
 public:
@@ -9,6 +10,12 @@ public:
     
     virtual unique_ptr<Visualisation> getVisualisation() = 0;
     virtual bool hasMoreVisualisations() = 0;
+    
+    // Particles the source's visualisations emit into, if any, which whoever draws the
+    // visualisations updates and draws along with them.
+    virtual shared_ptr<ParticleSystem> getParticleSystem(){
+        return nullptr;
+    }
 };
 
 class SphereVisualisationSource : public VisualisationSource {
@@ -22,12 +29,20 @@ public:
     }
 };
 
+// Cuts an image into a grid of sprites. By default every sprite gets its own texture; in
+// atlas mode they all share one texture of the whole image and differ only in texture
+// coordinates, so they can be drawn without texture switches.
 class SpriteVisualisationSource : public VisualisationSource {
 public:
     void setImageFilename(string imageFilename){
         this->imageFilename = imageFilename;
     }
     
+    // Must be called before setup().
+    void setIsUsingAtlas(bool isUsingAtlas){
+        this->isUsingAtlas = isUsingAtlas;
+    }
+    
     void setGridDimensions(int cols, int rows){
         this->cols = cols;
         this->rows = rows;
@@ -47,9 +62,18 @@ public:
         
         colWidth = source.getWidth() / cols;
         rowHeight = source.getHeight() / rows;
+        // Vertices a side. The 3 quads divide SpriteInstance's crumple lattice, so the
+        // vertices fall on lattice points and crumple as InstancedSpriteRenderer's do.
         planeResolution = 4;
         
         visualisations.reserve(cols * rows);
+        
+        if (isUsingAtlas){
+            atlas = make_shared<ofTexture>();
+            atlas->loadData(source.getPixels());
+        }else{
+            sliceTiles(source.getPixels());
+        }
 
         for (int row=0; row<rows; row++){
             for (int col=0; col<cols; col++){
@@ -57,6 +81,7 @@ public:
             }
         }
         
+        tiles.clear();
         index = 0;
     }
     
@@ -75,49 +100,92 @@ public:
     virtual float getRowHeight() const{
         return rowHeight;
     }
-        
+    
 protected:
     int index;
     string imageFilename;
     int cols, rows;
     float colWidth, rowHeight;
     int planeResolution;
+    bool isUsingAtlas = false;
+    shared_ptr<ofTexture> atlas;
+    // Tile pixels by row then column, only while setting up without an atlas.
+    vector<ofPixels> tiles;
     
     vector< unique_ptr<SpriteVisualisation> > visualisations;
         
     void createSprite(ofImage & source, int col, int row){
-        ofImage texture;
-        setUpTexture(texture, source, col, row);
         ofPlanePrimitive plane;
-        setUpPlane(plane, texture, col, row);
-        addVisualisation(plane, texture);
+        
+        if (isUsingAtlas){
+            setUpAtlasPlane(plane, col, row);
+            // The same pixel as (0, 0) of a flipped tile, the last row of the tile's rows in
+            // the source, see setUpTexture().
+            ofColor color = source.getColor(size_t(colWidth*col), size_t(rowHeight*row) + size_t(rowHeight) - 1);
+            addVisualisation(plane, atlas, color);
+        }else{
+            // Textures are uploaded here, on the thread that owns the GL context.
+            ofPixels & tile = tiles[row * cols + col];
+            shared_ptr<ofTexture> texture = make_shared<ofTexture>();
+            texture->loadData(tile);
+            setUpPlane(plane, *texture, col, row);
+            addVisualisation(plane, texture, tile.getColor(0, 0));
+        }
     }
     
-    void setUpTexture(ofImage & texture, ofImage & source, int col, int row){
-        ofPixels & sourcePixels = source.getPixels();
+    // Copies every tile out of the source pixels, spread over all cores. Only touches
+    // pixels, no GL. Logs how long it took.
+    void sliceTiles(const ofPixels & sourcePixels){
+        uint64_t startTime = ofGetElapsedTimeMicros();
         
-        texture.allocate(colWidth, rowHeight, OF_IMAGE_COLOR);
-        ofPixels & texturePixels = texture.getPixels();
+        tiles.resize(cols * rows);
         
-        for (int i=0; i<colWidth; i++){
-            for (int j=0; j<rowHeight; j++){
-                ofColor c = sourcePixels.getColor(colWidth*col + i, rowHeight*row + j);
-                texturePixels.setColor(i, rowHeight-j, c);
+        WorkerPool pool;
+        pool.setup(std::thread::hardware_concurrency());
+        pool.parallelFor(tiles.size(), 1, [&](size_t begin, size_t end){
+            for (size_t t=begin; t<end; t++){
+                setUpTexture(tiles[t], sourcePixels, t % cols, t / cols);
             }
-        }
+        });
+        
+        ofLogNotice() << "SpriteVisualisationSource::sliceTiles() Sliced " << tiles.size() << " tiles in "
+        << (ofGetElapsedTimeMicros() - startTime) / 1000.f << " ms on " << pool.getNumThreads() << " threads" << endl;
+    }
+    
+    // Copies the tile a row at a time, flipped vertically.
+    void setUpTexture(ofPixels & texturePixels, const ofPixels & sourcePixels, int col, int row){
+        size_t width = colWidth;
+        size_t height = rowHeight;
+        size_t numChannels = sourcePixels.getNumChannels();
+        size_t rowSize = width * numChannels;
+        size_t sourceRowSize = sourcePixels.getWidth() * numChannels;
+        const unsigned char * sourceData = sourcePixels.getData() + size_t(rowHeight*row) * sourceRowSize + size_t(colWidth*col) * numChannels;
+        
+        texturePixels.allocate(width, height, numChannels);
+        unsigned char * textureData = texturePixels.getData();
         
-        texture.update();
+        for (size_t j=0; j<height; j++){
+            memcpy(textureData + (height-1-j) * rowSize, sourceData + j * sourceRowSize, rowSize);
+        }
     }
     
-    void setUpPlane(ofPlanePrimitive & plane, ofImage & texture, int col, int row){
+    void setUpPlane(ofPlanePrimitive & plane, const ofTexture & texture, int col, int row){
         plane.set(colWidth, rowHeight, planeResolution, planeResolution);
         plane.mapTexCoords(0, 0, texture.getWidth(), texture.getHeight());
         plane.setPosition((col-cols/2.f) * texture.getWidth(), (row-rows/2.f) * texture.getHeight(), 0);
     }
     
-    virtual void addVisualisation(ofPlanePrimitive & plane, ofImage & texture){
+    // Maps the plane to the tile's rectangle of the atlas, upside down like the tile textures
+    // and half a texel in from the edges so that neighbouring tiles don't bleed in.
+    void setUpAtlasPlane(ofPlanePrimitive & plane, int col, int row){
+        plane.set(colWidth, rowHeight, planeResolution, planeResolution);
+        plane.mapTexCoords(colWidth*col + .5f, rowHeight*(row+1) - .5f, colWidth*(col+1) - .5f, rowHeight*row + .5f);
+        plane.setPosition((col-cols/2.f) * colWidth, (row-rows/2.f) * rowHeight, 0);
+    }
+    
+    virtual void addVisualisation(ofPlanePrimitive & plane, shared_ptr<ofTexture> texture, ofColor color){
         unique_ptr<SpriteVisualisation> visualisation = make_unique<SpriteVisualisation>();
-        visualisation->setup(plane, texture);
+        visualisation->setup(plane, texture, color);
         
         visualisations.push_back(move(visualisation));
     }
@@ -125,30 +193,50 @@ protected:
 
 class TornPaperVisualisationSource : public SpriteVisualisationSource {
 protected:
-    virtual void addVisualisation(ofPlanePrimitive & plane, ofImage & texture) override{
+    virtual void addVisualisation(ofPlanePrimitive & plane, shared_ptr<ofTexture> texture, ofColor color) override{
         unique_ptr<TornPaperVisualisation> visualisation = make_unique<TornPaperVisualisation>();
-        visualisation->setup(plane, texture);
+        visualisation->setup(plane, texture, color);
         
         visualisations.push_back(move(visualisation));
     }
 };
 
+// All the sprites emit into one ParticleSystem, which Agents updates and draws once after
+// the sprites, see getParticleSystem().
 class TornPaperWithParticlesVisualisationSource : public TornPaperVisualisationSource {
+public:
+    // Must be called before setup().
+    void setNumParticlesPerSprite(size_t numParticlesPerSprite){
+        this->numParticlesPerSprite = numParticlesPerSprite;
+    }
+    
+    virtual shared_ptr<ParticleSystem> getParticleSystem() override{
+        return particleSystem;
+    }
+    
 protected:
-    virtual void addVisualisation(ofPlanePrimitive & plane, ofImage & texture) override{
+    virtual void addVisualisation(ofPlanePrimitive & plane, shared_ptr<ofTexture> texture, ofColor color) override{
         unique_ptr<TornPaperWithParticlesVisualisation> visualisation = make_unique<TornPaperWithParticlesVisualisation>();
-        visualisation->setup(plane, texture);
+        visualisation->setParticleSystem(particleSystem, numParticlesPerSprite);
+        visualisation->setup(plane, texture, color);
         
         visualisations.push_back(move(visualisation));
     }
+    
+    size_t numParticlesPerSprite = 2000;
+    shared_ptr<ParticleSystem> particleSystem = make_shared<ParticleSystem>();
 };
 
+// All the sprites share one MorphStore, so uncrumpling the scene updates them together.
 class CrumpledPaperVisualisationSource : public SpriteVisualisationSource {
 protected:
-    virtual void addVisualisation(ofPlanePrimitive & plane, ofImage & texture) override{
+    virtual void addVisualisation(ofPlanePrimitive & plane, shared_ptr<ofTexture> texture, ofColor color) override{
         unique_ptr<UncrumplingPaperVisualisation> visualisation = make_unique<UncrumplingPaperVisualisation>();
-        visualisation->setup(plane, texture);
+        visualisation->setMorphStore(morphStore);
+        visualisation->setup(plane, texture, color);
         
         visualisations.push_back(move(visualisation));
     }
+    
+    shared_ptr<MorphStore> morphStore = make_shared<MorphStore>();
 };
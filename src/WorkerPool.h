@@ -0,0 +1,186 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <functional>
+#include <memory>
+
+// A persistent pool of worker threads for running parallel loops. Every participant
+// (the workers plus the calling thread) owns a queue of chunks; once its own queue is
+// empty it steals from the back of the others, so chunks of uneven cost balance out.
+// Chunk boundaries only depend on the count and grain size, never on the number of
+// threads or on scheduling, so per-chunk results are the same as a serial run.
+class WorkerPool {
+public:
+    ~WorkerPool(){
+        stop();
+    }
+
+    // Starts numThreads - 1 workers; the thread calling parallelFor is the last one.
+    void setup(size_t numThreads){
+        stop();
+
+        numThreads = std::max<size_t>(numThreads, 1);
+        queues.clear();
+
+        for (size_t i=0; i<numThreads; i++){
+            queues.push_back(std::unique_ptr<ChunkQueue>(new ChunkQueue()));
+        }
+
+        isStopping = false;
+
+        for (size_t i=1; i<numThreads; i++){
+            workers.emplace_back(&WorkerPool::workerLoop, this, i);
+        }
+    }
+
+    size_t getNumThreads() const{
+        return std::max<size_t>(queues.size(), 1);
+    }
+
+    // Calls function(begin, end) for consecutive chunks of [0, count) of grainSize elements
+    // (the last one may be shorter) and returns once every chunk has run.
+    void parallelFor(size_t count, size_t grainSize, const std::function<void(size_t, size_t)> & function){
+        if (count == 0){
+            return;
+        }
+
+        grainSize = std::max<size_t>(grainSize, 1);
+        size_t numChunks = (count + grainSize - 1) / grainSize;
+
+        if (workers.empty() || numChunks == 1){
+            for (size_t begin=0; begin<count; begin+=grainSize){
+                function(begin, std::min(begin + grainSize, count));
+            }
+            return;
+        }
+
+        // Count the chunks before queueing them, as a worker still busy from the previous
+        // loop may steal one as soon as it is queued.
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            remainingChunks = numChunks;
+        }
+
+        // Deal chunks out in contiguous runs so each participant starts on nearby data.
+        size_t chunksPerQueue = (numChunks + queues.size() - 1) / queues.size();
+
+        for (size_t chunk=0; chunk<numChunks; chunk++){
+            size_t begin = chunk * grainSize;
+            ChunkQueue & queue = *queues[chunk / chunksPerQueue];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.chunks.push_back({ begin, std::min(begin + grainSize, count), &function });
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            jobGeneration++;
+        }
+        jobStarted.notify_all();
+
+        runChunks(0);
+
+        std::unique_lock<std::mutex> lock(jobMutex);
+        jobFinished.wait(lock, [this]{ return remainingChunks == 0; });
+    }
+
+    void stop(){
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            isStopping = true;
+        }
+        jobStarted.notify_all();
+
+        for (auto & worker : workers){
+            worker.join();
+        }
+
+        workers.clear();
+    }
+
+protected:
+    // Chunks carry their loop body, so a worker that wakes late can never run a chunk
+    // of one parallelFor with the function of another.
+    struct Chunk {
+        size_t begin, end;
+        const std::function<void(size_t, size_t)> * function;
+    };
+
+    struct ChunkQueue {
+        std::mutex mutex;
+        std::deque<Chunk> chunks;
+    };
+
+    bool popOwn(size_t queueIndex, Chunk & chunk){
+        ChunkQueue & queue = *queues[queueIndex];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        if (queue.chunks.empty()){
+            return false;
+        }
+
+        chunk = queue.chunks.front();
+        queue.chunks.pop_front();
+        return true;
+    }
+
+    bool steal(size_t thiefIndex, Chunk & chunk){
+        for (size_t offset=1; offset<queues.size(); offset++){
+            ChunkQueue & queue = *queues[(thiefIndex + offset) % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+
+            if (!queue.chunks.empty()){
+                chunk = queue.chunks.back();
+                queue.chunks.pop_back();
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void runChunks(size_t queueIndex){
+        Chunk chunk;
+
+        while (popOwn(queueIndex, chunk) || steal(queueIndex, chunk)){
+            (*chunk.function)(chunk.begin, chunk.end);
+
+            std::lock_guard<std::mutex> lock(jobMutex);
+            if (--remainingChunks == 0){
+                jobFinished.notify_all();
+            }
+        }
+    }
+
+    void workerLoop(size_t queueIndex){
+        size_t seenGeneration = 0;
+
+        while (true){
+            {
+                std::unique_lock<std::mutex> lock(jobMutex);
+                jobStarted.wait(lock, [&]{ return isStopping || jobGeneration != seenGeneration; });
+
+                if (isStopping){
+                    return;
+                }
+
+                seenGeneration = jobGeneration;
+            }
+
+            runChunks(queueIndex);
+        }
+    }
+
+    std::vector< std::unique_ptr<ChunkQueue> > queues;
+    std::vector<std::thread> workers;
+
+    std::mutex jobMutex;
+    std::condition_variable jobStarted, jobFinished;
+    size_t remainingChunks = 0;
+    size_t jobGeneration = 0;
+    bool isStopping = false;
+};
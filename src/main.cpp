@@ -1,14 +1,103 @@
 #include "ofMain.h"
 #include "ofApp.h"
+#include "RenderLauncher.h"
+
+// --export <directory> renders offline instead of running live, with
+// --size <width>x<height>, --fps <frames per second>, --start <first frame>,
+// --frames <number of frames>, --format png|raw, --seed <number>,
+// --encoders <number of threads> and --threads <number of simulation threads>.
+// --workers <number of processes> splits the frames across that many processes.
+// Options that don't set the range or threads are kept in rangeArguments, for workers.
+ofApp::ExportSettings parseExportSettings(int argc, char * argv[], size_t & numWorkers, vector<string> & rangeArguments){
+    ofApp::ExportSettings exportSettings;
+    numWorkers = 1;
+
+    for (int i=1; i+1<argc; i+=2){
+        string option = argv[i];
+        string value = argv[i + 1];
+
+        if (option != "--start" && option != "--frames" && option != "--workers" && option != "--encoders" && option != "--threads"){
+            rangeArguments.insert(rangeArguments.end(), {option, value});
+        }
+
+        if (option == "--export"){
+            exportSettings.isExporting = true;
+            exportSettings.exporter.directory = value;
+        }else if (option == "--size"){
+            auto size = ofSplitString(value, "x");
+            if (size.size() == 2){
+                exportSettings.exporter.width = ofToInt(size[0]);
+                exportSettings.exporter.height = ofToInt(size[1]);
+            }
+        }else if (option == "--fps"){
+            exportSettings.framesPerSecond = ofToFloat(value);
+        }else if (option == "--start"){
+            exportSettings.startFrame = max(ofToInt(value), 0);
+        }else if (option == "--frames"){
+            exportSettings.numFrames = max(ofToInt(value), 0);
+        }else if (option == "--format"){
+            exportSettings.exporter.format = value == "raw" ? FrameExporter::Format::Raw : FrameExporter::Format::Png;
+        }else if (option == "--seed"){
+            exportSettings.seed = ofToInt(value);
+        }else if (option == "--encoders"){
+            exportSettings.exporter.numEncoderThreads = ofToInt(value);
+        }else if (option == "--threads"){
+            exportSettings.numThreads = ofToInt(value);
+        }else if (option == "--workers"){
+            numWorkers = ofToInt(value);
+        }else{
+            ofLogWarning() << "Unknown option " << option << endl;
+        }
+    }
+
+    return exportSettings;
+}
 
 //========================================================================
-int main( ){
+int main(int argc, char * argv[]){
+    size_t numWorkers;
+    vector<string> rangeArguments;
+    ofApp::ExportSettings exportSettings = parseExportSettings(argc, argv, numWorkers, rangeArguments);
+    
+    if (exportSettings.isExporting && exportSettings.numFrames == 0){
+        ofLogError() << "--frames must be at least 1" << endl;
+        return 1;
+    }
+    
+    // Launching workers needs no window; they share out the cores.
+    if (exportSettings.isExporting && numWorkers > 1){
+        size_t numThreadsPerWorker = max<size_t>(thread::hardware_concurrency() / numWorkers, 1);
+        rangeArguments.insert(rangeArguments.end(), {
+            "--encoders", ofToString(numThreadsPerWorker),
+            "--threads", ofToString(numThreadsPerWorker)
+        });
+        
+        RenderLauncher launcher;
+        int result = launcher.run(RenderLauncher::getExecutablePath(argv[0]), rangeArguments, exportSettings.startFrame, exportSettings.numFrames, numWorkers);
+        
+        string extension = exportSettings.exporter.format == FrameExporter::Format::Raw ? "raw" : "png";
+        auto missingFrames = RenderLauncher::findMissingFrames(exportSettings.exporter.directory, extension, exportSettings.startFrame, exportSettings.numFrames);
+        if (!missingFrames.empty()){
+            ofLogError() << missingFrames.size() << " frames are missing, the first is " << missingFrames.front() << endl;
+            return 1;
+        }
+        
+        return result;
+    }
+
     ofGLWindowSettings settings;
     settings.setGLVersion(3, 2);
     settings.setSize(800, 600);
-    
+
     ofCreateWindow(settings);
-    ofSetFullscreen(true);
-    
-	ofRunApp(new ofApp());
+
+    // Agents are placed relative to the window, so an export keeps its size the same on
+    // every machine.
+    if (!exportSettings.isExporting){
+        ofSetFullscreen(true);
+    }
+
+    ofApp * app = new ofApp();
+    app->setExportSettings(exportSettings);
+	ofRunApp(app);
 }
@@ -1,15 +1,54 @@
 #include "ofApp.h"
 
+//--------------------------------------------------------------
+void ofApp::setExportSettings(const ExportSettings & exportSettings){
+    this->exportSettings = exportSettings;
+}
+
 //--------------------------------------------------------------
 void ofApp::setup(){
+    if (exportSettings.isExporting){
+        if (exportSettings.numFrames == 0){
+            ofLogError() << "ofApp::setup() An export needs at least one frame" << endl;
+            ofExit(1);
+            return;
+        }
+        
+        // Everything random from here on follows from the seed, and nothing waits for vsync.
+        ofSeedRandom(exportSettings.seed);
+        FrameClock::setFixedTime(0.);
+        ofSetVerticalSync(false);
+        ofSetFrameRate(0);
+        
+        if (!frameExporter.setup(exportSettings.exporter)){
+            ofExit(1);
+            return;
+        }
+        
+        // Nothing is played; the music's level comes from the file, as if it started with
+        // the export.
+        music.setupOffline("ArTeaser_Edit05.wav", SimulationTicksPerSecond);
+    }
+    
     visualisationSource.setImageFilename("Cover01.jpg");
     visualisationSource.setGridDimensions(Cols, Rows);
+    visualisationSource.setIsUsingAtlas(true);
     visualisationSource.setup();
     sphereRovingAgentSource.setup();
 
     agents = make_shared<Agents>();
+    agents->setNumThreads(exportSettings.isExporting ? exportSettings.numThreads : std::thread::hardware_concurrency());
+    agents->setSeparation(AgentSeparationRadius, AgentSeparationWeight);
     agents->setup(sphereRovingAgentSource, visualisationSource, MaxAgents);
+    
+    // An export steps the simulation itself, see update().
+    if (SimulateOnOwnThread && !exportSettings.isExporting){
+        agents->startThreadedSimulation(SimulationTicksPerSecond);
+    }
+    
     agentsShader.load("shaders_gl3/topLighting");
+    spriteRenderer.setup();
+    agents->setSpriteRenderer(&spriteRenderer);
     
     textRovingAgentSource.setup();
     basicBoundAgentSource.setup();
@@ -19,7 +58,19 @@ void ofApp::setup(){
     
     poster.setup("Cover01.jpg");
     
-//    shadows.setup(agents, DesiredCamDistance);
+    shadows.setup(agents, DesiredCamDistance);
+    shadows.setMotionThreshold(ShadowMotionThreshold);
+    shadows.setMaxUpdateRate(ShadowMaxUpdateRate);
+    shadows.setTemporalBlend(ShadowTemporalBlend);
+    shadows.setBackend(ShadowBackend);
+    
+    // A frame of an export can't depend on the frames drawn before it, as a range starting
+    // later doesn't draw them, so its shadows are rendered afresh every frame.
+    if (exportSettings.isExporting){
+        shadows.setMotionThreshold(0.f);
+        shadows.setMaxUpdateRate(0.f);
+        shadows.setTemporalBlend(1.f);
+    }
 
     texts.setup();
     texts.addText("ARLEQUINO", "Ubuntu-R.ttf", 380, "DropShadow_ARLEQUINO.png", ofVec2f(1.09584664536741, 1.59405940594059));
@@ -35,23 +86,66 @@ void ofApp::setup(){
 
 //--------------------------------------------------------------
 void ofApp::update(){
-    music.update();
-    float visualScaling = music.getLevel() * 25.f;
-    agents->update(visualScaling);
-    cam.update();
+    if (exportSettings.isExporting){
+        updateExport();
+    }else{
+        music.update();
+        agents->update(music.getLevel() * 25.f);
+        cam.update();
+    }
+    
+    if (poster.isOpaque()){
+        agents->setOccluder(poster.getCorners());
+    }else{
+        agents->clearOccluder();
+    }
 }
 
 //--------------------------------------------------------------
 void ofApp::draw(){
+    if (exportSettings.isExporting){
+        drawExport();
+        return;
+    }
+    
+    drawScene();
+    
+    // Draw options.
+    ofPushStyle();
+    ofSetColor(0, 0, 0);
+    ofDrawBitmapString("Options:", 20, 40);
+    ofDrawBitmapString("m - (Start) music", 20, 60);
+    ofDrawBitmapString("t - Text", 20, 80);
+    ofDrawBitmapString("s - Sphere", 20, 100);
+    auto & cullStats = agents->getCullStats();
+    ofDrawBitmapString("Drawn " + ofToString(cullStats.getNumDrawn()) + " of " + ofToString(cullStats.numTested) + " agents ("
+                       + ofToString(cullStats.numOutsideFrustum) + " outside view, " + ofToString(cullStats.numOccluded) + " behind poster)", 20, 140);
+    auto & shadowStats = shadows.getStats();
+    ofDrawBitmapString("Shadows " + ofToString(shadowStats.millisPerFrame, 2) + " ms per frame, " + ofToString(shadowStats.millisPerRender, 2) + " ms per render, "
+                       + ofToString(shadowStats.rendersPerSecond, 1) + " renders per second", 20, 160);
+    ofPopStyle();
+}
+
+//--------------------------------------------------------------
+void ofApp::exit(){
+    if (exportSettings.isExporting){
+        frameExporter.finish();
+    }
+}
+
+//--------------------------------------------------------------
+void ofApp::drawScene(){
     cam.begin();
 
-    // Draw agents.
+    // Draw agents. Sprites are drawn last, under the sprite renderer's shader.
+    if (spriteRenderer.isReady()){
+        spriteRenderer.getShader().begin();
+        setAgentsLighting(spriteRenderer.getShader());
+        spriteRenderer.getShader().end();
+    }
+    
     agentsShader.begin();
-    agentsShader.setUniform1f("alpha", ofMap(music.getLevel(), 0.f, 0.15f, 0.f, .4f, true));
-    agentsShader.setUniform1f("toplightStartY", 800.f);
-    agentsShader.setUniform1f("toplightIntensity", .45f);
-    agentsShader.setUniform1f("topLightEndY", -800.f);
-    agentsShader.setUniform1f("ambientLight", .8f);
+    setAgentsLighting(agentsShader);
     agents->draw();
     agentsShader.end();
     
@@ -62,18 +156,95 @@ void ofApp::draw(){
     ofSetColor(0, 255, 255);
     ofPopStyle();
 
-//    shadows.draw(ofMap(music.getLevel(), 0.f, 0.05f, 0.3f, 1.f, true));
+    shadows.draw(ofMap(music.getLevel(), 0.f, 0.05f, 0.3f, 1.f, true));
 
     cam.end();
+}
 
-    // Draw options.
+//--------------------------------------------------------------
+// The first update of a range that doesn't start at frame 0 fast-forwards through the
+// frames before it.
+void ofApp::updateExport(){
+    while (exportFrameNum < exportSettings.startFrame){
+        simulateExportFrame(exportFrameNum);
+        exportFrameNum++;
+    }
+    
+    if (exportFrameNum < exportSettings.startFrame + exportSettings.numFrames){
+        simulateExportFrame(exportFrameNum);
+    }
+}
+
+//--------------------------------------------------------------
+// Simulates up to the time of frameNum, running the ticks of SimulationTicksPerSecond that
+// fall within the frame, whatever the frame rate, and pressing any keys cued on the way.
+// The music's level follows the clock.
+void ofApp::simulateExportFrame(uint64_t frameNum){
+    // Ticks are counted from the frame number rather than added up, which would drift.
+    uint64_t firstTick = getExportTicksBefore(frameNum) + 1;
+    uint64_t lastTick = getExportTicksBefore(frameNum + 1);
+    
+    for (uint64_t tick=firstTick; tick<=lastTick; tick++){
+        double time = tick / double(SimulationTicksPerSecond);
+        FrameClock::setFixedTime(time);
+        music.seek(time);
+        
+        while (nextExportCue < ExportCues.size() && ExportCues[nextExportCue].first <= FrameClock::getElapsedTimef()){
+            triggerKey(ExportCues[nextExportCue].second);
+            nextExportCue++;
+        }
+        
+        agents->update(music.getLevel() * 25.f);
+    }
+    
+    // The frame is drawn at its own time, which may fall between ticks.
+    double frameTime = (frameNum + 1) / double(exportSettings.framesPerSecond);
+    FrameClock::setFixedTime(frameTime);
+    music.seek(frameTime);
+}
+
+//--------------------------------------------------------------
+// How many ticks have run by the time frameNum starts.
+uint64_t ofApp::getExportTicksBefore(uint64_t frameNum){
+    return floor(frameNum * double(SimulationTicksPerSecond) / exportSettings.framesPerSecond + ExportTickTolerance);
+}
+
+//--------------------------------------------------------------
+void ofApp::drawExport(){
+    uint64_t endFrame = exportSettings.startFrame + exportSettings.numFrames;
+    if (exportFrameNum >= endFrame){
+        return;
+    }
+    
+    frameExporter.begin();
+    ofClear(255.f, 255.f);
+    drawScene();
+    frameExporter.end(exportFrameNum);
+    exportFrameNum++;
+    
+    // Preview.
+    frameExporter.getTexture().draw(0.f, 0.f, ofGetWidth(), ofGetHeight());
     ofPushStyle();
     ofSetColor(0, 0, 0);
-    ofDrawBitmapString("Options:", 20, 40);
-    ofDrawBitmapString("m - (Start) music", 20, 60);
-    ofDrawBitmapString("t - Text", 20, 80);
-    ofDrawBitmapString("s - Sphere", 20, 100);
+    ofDrawBitmapString("Exporting frame " + ofToString(exportFrameNum - exportSettings.startFrame) + " of " + ofToString(exportSettings.numFrames) + ", "
+                       + ofToString(frameExporter.getNumFramesWritten()) + " written, " + ofToString(ofGetFrameRate(), 1) + " fps", 20, 40);
     ofPopStyle();
+    
+    if (exportFrameNum == endFrame){
+        frameExporter.finish();
+        ofLogNotice() << "Exported " << frameExporter.getNumFramesWritten() << " frames to " << exportSettings.exporter.directory << endl;
+        ofExit();
+    }
+}
+
+//--------------------------------------------------------------
+// Must be called between shader.begin() and shader.end().
+void ofApp::setAgentsLighting(ofShader & shader){
+    shader.setUniform1f("alpha", ofMap(music.getLevel(), 0.f, 0.15f, 0.f, .4f, true));
+    shader.setUniform1f("toplightStartY", 800.f);
+    shader.setUniform1f("toplightIntensity", .45f);
+    shader.setUniform1f("topLightEndY", -800.f);
+    shader.setUniform1f("ambientLight", .8f);
 }
 
 //--------------------------------------------------------------
@@ -83,6 +254,14 @@ void ofApp::keyPressed(int key){
 
 //--------------------------------------------------------------
 void ofApp::keyReleased(int key){
+    // An export only follows its cues.
+    if (!exportSettings.isExporting){
+        triggerKey(key);
+    }
+}
+
+//--------------------------------------------------------------
+void ofApp::triggerKey(int key){
     if (key == 'm'){
         music.setup("ArTeaser_Edit05.wav");
     }else{
@@ -92,14 +271,14 @@ void ofApp::keyReleased(int key){
         
         if (key == 't'){
             texts.cycleText();
-            textRovingAgentSource.setLetterPaths(texts.getLetterPaths(), texts.getDrawPosition());
+            textRovingAgentSource.setLetters(texts.getLetters());
             agents->transitionAgents(textRovingAgentSource, 1.f);
             texts.animateIn();
         }else if (key == 'r'){
             texts.cycleText();
             auto h = texts.getBoundingBox().getHeight()*.4f;
             simplerTextRovingAgentSource.setMinimumPointDistance(texts.getBoundingBox().getHeight()*.4f);
-            simplerTextRovingAgentSource.setLetterPaths(texts.getLetterPaths(), texts.getDrawPosition());
+            simplerTextRovingAgentSource.setLetters(texts.getLetters(), texts.getGlyphCache(), texts.getDrawPosition());
             agents->transitionAgents(simplerTextRovingAgentSource, 1.f);
             texts.animateIn();
         }else if (key == 's'){
@@ -13,18 +13,43 @@
 #include "Text.h"
 #include "Poster.h"
 #include "Camera.h"
-//#include "Shadows.h"
+#include "Shadows.h"
+#include "FrameExporter.h"
 
 class ofApp : public ofBaseApp{
     
 public:
+    // Renders a range of frames to disk instead of running live, with the clock stepped a
+    // frame at a time and the scene driven by ExportCues. The frames before the range are
+    // simulated but not drawn, so any range of an export comes out the same as it does in
+    // the whole. Call before setup().
+    struct ExportSettings {
+        bool isExporting = false;
+        FrameExporter::Settings exporter;
+        float framesPerSecond = 60.f;
+        uint64_t startFrame = 0;
+        uint64_t numFrames = 60 * 30;
+        int seed = 0;
+        size_t numThreads = max<size_t>(thread::hardware_concurrency(), 1);
+    };
+    
+    void setExportSettings(const ExportSettings & exportSettings);
+    
     void setup();
     void update();
     void draw();
+    void exit();
+    void updateExport();
+    void simulateExportFrame(uint64_t frameNum);
+    uint64_t getExportTicksBefore(uint64_t frameNum);
+    void drawExport();
+    void drawScene();
     void drawText();
+    void setAgentsLighting(ofShader & shader);
     
     void keyPressed(int key);
     void keyReleased(int key);
+    void triggerKey(int key);
     void mouseMoved(int x, int y );
     void mouseDragged(int x, int y, int button);
     void mousePressed(int x, int y, int button);
@@ -41,6 +66,23 @@ protected:
     const int MaxAgents = 1000;
     const float DesiredCamDistance = 2000;
     const float DefaultCamDistance = 650;
+    const bool SimulateOnOwnThread = true;
+    const float SimulationTicksPerSecond = 60.f;
+    // Frame times that are whole ticks still count that tick after rounding.
+    const double ExportTickTolerance = .001;
+    const float AgentSeparationRadius = 20.f;
+    const float AgentSeparationWeight = .1f;
+    // The floor shadow is rendered again once an agent moves this far, at most this often.
+    const float ShadowMotionThreshold = 4.f;
+    const float ShadowMaxUpdateRate = 20.f;
+    const float ShadowTemporalBlend = .5f;
+    // CpuSplat shadows every agent at a fixed cost, for scenes with many agents.
+    const Shadows::Backend ShadowBackend = Shadows::Backend::Gpu;
+    // Keys pressed during an export, at seconds on the frame clock, as the live show has no
+    // one at the keyboard.
+    const vector< pair<float, int> > ExportCues = {
+        {2.f, 'v'}, {5.f, 'c'}, {7.f, 't'}, {12.f, 's'}, {16.f, 'r'}, {21.f, 's'}
+    };
     
     Camera cam;
     shared_ptr<Agents> agents;
@@ -54,5 +96,11 @@ protected:
     Texts texts;
     Poster poster;
     ofShader agentsShader;
-//    Shadows shadows;
+    InstancedSpriteRenderer spriteRenderer;
+    Shadows shadows;
+    
+    ExportSettings exportSettings;
+    FrameExporter frameExporter;
+    uint64_t exportFrameNum = 0;
+    size_t nextExportCue = 0;
 };